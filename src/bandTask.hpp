@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// one piece of work split into bands that any thread can take. bands are
+// claimed off a counter, so whichever thread is free takes the next one,
+// and the thread that started the task runs whatever is left itself before
+// waiting on the bands other threads took. nothing depends on helpers ever
+// showing up, they just make it finish sooner.
+class bandTask {
+	public:
+		typedef std::shared_ptr<bandTask> ptr;
+
+		bandTask(unsigned _count, std::function<void(unsigned)> _fn)
+			: count(_count), fn(std::move(_fn)) {}
+
+		// runs one band nobody has claimed yet, returns false once
+		// they've all been claimed
+		bool help(void) {
+			unsigned band = next.fetch_add(1);
+
+			if (band >= count) {
+				return false;
+			}
+
+			fn(band);
+
+			if (done.fetch_add(1) + 1 == count) {
+				std::lock_guard<std::mutex> g(mtx);
+				finished.notify_all();
+			}
+
+			return true;
+		}
+
+		// runs bands until none are left, then waits for the rest
+		void run(void) {
+			while (help());
+
+			std::unique_lock<std::mutex> lock(mtx);
+			finished.wait(lock, [this] { return done == count; });
+		}
+
+	private:
+		const unsigned count;
+		std::function<void(unsigned)> fn;
+		std::atomic<unsigned> next = 0;
+		std::atomic<unsigned> done = 0;
+		std::mutex mtx;
+		std::condition_variable finished;
+};
@@ -0,0 +1,147 @@
+// compares heightfield and triangle mesh colliders for terrain tiles,
+// how long the shapes take to build, how big they are, and what a physics
+// step costs with a bunch of spheres rolling around on them.
+//
+// doesn't need a window or the engine, just bullet:
+//   collider-bench [tiles per side] [spheres] [steps]
+#include <btBulletDynamicsCommon.h>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "landscapeTile.hpp"
+#include "terrainShape.hpp"
+
+static const uint32_t benchSeed = 0xcafebabe;
+static const float    cellsize = 24.f;
+static const float    unit = 2.f;
+
+typedef std::chrono::steady_clock benchClock;
+
+static double msSince(benchClock::time_point start) {
+	auto now = benchClock::now();
+	return std::chrono::duration<double, std::milli>(now - start).count();
+}
+
+struct benchResult {
+	double buildMs = 0;
+	size_t bytes = 0;
+	double stepMs = 0;
+};
+
+static benchResult runBench(bool heightfield,
+                            const std::vector<tileData>& tiles,
+                            int spheres,
+                            int steps)
+{
+	benchResult ret;
+	std::vector<terrainShape> shapes;
+
+	auto start = benchClock::now();
+	for (auto& data : tiles) {
+		if (heightfield) {
+			shapes.push_back(makeHeightfieldShape(data));
+		} else {
+			// skirts are left out, they're below the surface anyway
+			tileMesh mesh = buildTileMesh(data, 0);
+			shapes.push_back(makeMeshShape(mesh, glm::vec3(data.x, 0, data.z)));
+		}
+	}
+	ret.buildMs = msSince(start) / tiles.size();
+
+	for (auto& shape : shapes) {
+		ret.bytes += shape.bytes;
+	}
+	ret.bytes /= shapes.size();
+
+	btDefaultCollisionConfiguration config;
+	btCollisionDispatcher dispatcher(&config);
+	btDbvtBroadphase broadphase;
+	btSequentialImpulseConstraintSolver solver;
+	btDiscreteDynamicsWorld world(&dispatcher, &broadphase, &solver, &config);
+	world.setGravity(btVector3(0, -15, 0));
+
+	std::vector<std::unique_ptr<btRigidBody>> bodies;
+	std::vector<std::unique_ptr<btMotionState>> motions;
+
+	for (auto& shape : shapes) {
+		btRigidBody::btRigidBodyConstructionInfo info(0, nullptr, shape.shape.get());
+		info.m_startWorldTransform = shape.transform;
+		bodies.emplace_back(new btRigidBody(info));
+		world.addRigidBody(bodies.back().get());
+	}
+
+	btSphereShape ball(0.5f);
+	btVector3 inertia;
+	ball.calculateLocalInertia(1.f, inertia);
+	float extent = cellsize * sqrtf(tiles.size());
+
+	// same positions for both runs
+	srand(1234);
+	for (int i = 0; i < spheres; i++) {
+		btTransform transform;
+		transform.setIdentity();
+		transform.setOrigin(btVector3(extent * (rand() / float(RAND_MAX)),
+		                              60 + 10 * (rand() / float(RAND_MAX)),
+		                              extent * (rand() / float(RAND_MAX))));
+
+		motions.emplace_back(new btDefaultMotionState(transform));
+		btRigidBody::btRigidBodyConstructionInfo
+			info(1.f, motions.back().get(), &ball, inertia);
+		bodies.emplace_back(new btRigidBody(info));
+		bodies.back()->setActivationState(DISABLE_DEACTIVATION);
+		world.addRigidBody(bodies.back().get());
+	}
+
+	// let everything land before timing anything
+	for (int i = 0; i < 120; i++) {
+		world.stepSimulation(1/60.f, 1, 1/60.f);
+	}
+
+	start = benchClock::now();
+	for (int i = 0; i < steps; i++) {
+		world.stepSimulation(1/60.f, 1, 1/60.f);
+	}
+	ret.stepMs = msSince(start) / steps;
+
+	for (auto& body : bodies) {
+		world.removeRigidBody(body.get());
+	}
+
+	return ret;
+}
+
+int main(int argc, char *argv[]) {
+	int side    = (argc > 1)? atoi(argv[1]) : 9;
+	int spheres = (argc > 2)? atoi(argv[2]) : 200;
+	int steps   = (argc > 3)? atoi(argv[3]) : 600;
+
+	if (side <= 0 || spheres < 0 || steps <= 0) {
+		fprintf(stderr, "usage: %s [tiles per side] [spheres] [steps]\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<tileData> tiles;
+	for (int x = 0; x < side; x++) {
+		for (int z = 0; z < side; z++) {
+			tiles.push_back(sampleTile(benchSeed, x*cellsize, z*cellsize,
+			                           cellsize, unit));
+		}
+	}
+
+	printf("%d tiles of %gm at %gm spacing, %d spheres, %d steps\n",
+	       side*side, cellsize, unit, spheres, steps);
+	printf("%-12s %14s %14s %14s\n", "collider", "build ms/tile", "bytes/tile", "ms/step");
+
+	for (bool heightfield : {false, true}) {
+		benchResult res = runBench(heightfield, tiles, spheres, steps);
+		printf("%-12s %14.4f %14zu %14.4f\n",
+		       heightfield? "heightfield" : "mesh",
+		       res.buildMs, res.bytes, res.stepMs);
+	}
+
+	return 0;
+}
@@ -0,0 +1,630 @@
+// headless terrain generation benchmark, moves a view window along a
+// scripted path and builds tiles on worker threads the same way the
+// generator does. the window itself is the generator's (see tileWindow.hpp),
+// so it's the same queue, prefetching, cache and tile events, with the same
+// levels of detail, sampling, meshing and grass scattering. everything that
+// needs the engine (models, GPU uploads, physics) is left out.
+//
+// after each step along the path it waits for everything queued to be
+// built before moving on, so every run builds exactly the same tiles and
+// the numbers can be compared between builds:
+//   landscape-bench [straight|circle|zigzag|all|verify] [cells] [threads] [cellsize]
+//
+// verify runs every path once on one thread and once on the given number,
+// hashing everything built for each tile (samples, mesh, grass) and the
+// tile events sent, and exits with 1 if anything came out different.
+// neither can depend on which thread built a tile or in what order. it
+// does that twice: once waiting after each step as above, and once moving
+// on after a few tiles each step, so the window keeps moving before it's
+// complete, queued tiles get dropped or replaced and finished ones come
+// back out of the cache along the way
+//
+// tiles big enough to be split into bands (see sampleTile()) get help from
+// workers that have nothing queued, same as in the generator
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/resource.h>
+
+#include "bandTask.hpp"
+#include "landscapeTile.hpp"
+#include "tileLod.hpp"
+#include "tileQueue.hpp"
+#include "tileWindow.hpp"
+
+static const uint32_t benchSeed = 0xcafebabe;
+static float          cellsize = 24.f;
+static const int      gridsize = 9;
+// walking speed along the path (m/s), for prefetching and the queue's lead
+static const float    benchSpeed = 8.f;
+// finished tiles kept after they leave the window, the window only keeps
+// the size of each tile's samples here so this is a lot less than the
+// generator's default
+static const size_t   benchCacheBytes = 64*1024;
+// in the overlap run of verify, meters moved and tiles built per step
+static const float    overlapStep = 3.f;
+static const unsigned overlapTiles = 3;
+
+// every allocation in the process, tiles and the window are the only
+// things allocating while the clock is running
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (void *ptr = malloc(size? size : 1)) {
+		return ptr;
+	}
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+	free(ptr);
+}
+
+typedef std::chrono::steady_clock benchClock;
+
+static double msSince(benchClock::time_point start) {
+	auto now = benchClock::now();
+	return std::chrono::duration<double, std::milli>(now - start).count();
+}
+
+// position along a path after travelling dist meters
+typedef glm::vec2 (*benchPath)(float dist, float length);
+
+static glm::vec2 straightPath(float dist, float length) {
+	return glm::vec2(dist, cellsize*0.5f);
+}
+
+// one lap over the whole length
+static glm::vec2 circlePath(float dist, float length) {
+	float radius = length / (2*M_PI);
+	float a = dist / radius;
+	return glm::vec2(radius*cosf(a), radius*sinf(a));
+}
+
+// diagonal legs four cells across, turning around at each edge
+static glm::vec2 zigzagPath(float dist, float length) {
+	float leg = 4*cellsize;
+	float d = dist / sqrtf(2.f);
+	float t = fmodf(d, 2*leg);
+
+	return glm::vec2(d, (t < leg)? t : 2*leg - t);
+}
+
+struct benchResult {
+	size_t tiles = 0;
+	double seconds = 0;
+	// worker time to build each tile, and time from the crossing that
+	// wanted it until it was done
+	std::vector<double> buildMs;
+	std::vector<double> latencyMs;
+	size_t allocations = 0;
+	// sampled data each tile keeps while it's resident
+	size_t dataBytes = 0;
+	// total time in each stage the bench runs
+	double sampleMs = 0;
+	double meshMs = 0;
+	double vegetationMs = 0;
+	// with hashing on, a hash of everything built for each tile at each
+	// level, and how many rebuilds of a tile didn't match its first build
+	std::map<std::pair<tileCoord, unsigned>, uint64_t> hashes;
+	size_t inconsistent = 0;
+	// tile events in the order the window sent them
+	size_t events = 0;
+	uint64_t eventHash = 0;
+	// totals of the window's counters over every move, and tiles taken
+	// back out of the cache
+	size_t dropped = 0;
+	size_t promoted = 0;
+	size_t cacheHits = 0;
+};
+
+// the window only keeps the size of each tile's samples
+typedef tileWindow<size_t> benchWindow;
+
+static const uint64_t fnvBasis = 14695981039346656037ull;
+
+static uint64_t fnv1a(const void *data, size_t len, uint64_t hash = fnvBasis) {
+	const uint8_t *p = (const uint8_t*)data;
+
+	for (size_t i = 0; i < len; i++) {
+		hash ^= p[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+template <typename T>
+static uint64_t fnv1a(const std::vector<T>& v, uint64_t hash = fnvBasis) {
+	return fnv1a(v.data(), v.size() * sizeof(T), hash);
+}
+
+static uint64_t hashTile(const tileData& data) {
+	float header[3] = {data.x, data.z, data.unit};
+	uint64_t ret = fnv1a(header, sizeof(header));
+
+	ret = fnv1a(&data.samples, sizeof(data.samples), ret);
+	ret = fnv1a(data.heights, ret);
+	ret = fnv1a(data.normals, ret);
+	return fnv1a(data.trees, ret);
+}
+
+class benchRunner {
+	public:
+		benchRunner(unsigned threads) {
+			for (unsigned i = 0; i < threads; i++) {
+				workers.emplace_back([this] { work(); });
+			}
+		}
+
+		~benchRunner() {
+			{
+				std::lock_guard<std::mutex> g(mtx);
+				stopping = true;
+			}
+
+			wake.notify_all();
+
+			for (auto& t : workers) {
+				t.join();
+			}
+		}
+
+		// with overlap set, tiles are built on this thread a few at a
+		// time and the path moves on without waiting for the window, the
+		// workers only help with big tiles
+		benchResult run(benchPath path, int cells, bool hash = false,
+		                bool overlap = false)
+		{
+			benchResult ret;
+			hashing = hash;
+			float length = cells * cellsize;
+			float step = overlap? overlapStep : 1.f;
+
+			ret.eventHash = fnvBasis;
+			result = &ret;
+			size_t startAllocs = allocations;
+			auto start = benchClock::now();
+
+			benchWindow::callbacks cb;
+			cb.crossed = [this] (tileCoord) {
+				std::lock_guard<std::mutex> g(mtx);
+				crossedAt = benchClock::now();
+			};
+			cb.queued = [this] {
+				// takes the lock so a worker can't miss the push
+				{ std::lock_guard<std::mutex> g(mtx); }
+				wake.notify_one();
+			};
+			cb.show = [] (tileCoord, const size_t&, bool) {};
+			cb.hide = [] (tileCoord, const size_t&) {};
+			cb.bytes = [] (const size_t& bytes) { return bytes; };
+			cb.event = [this] (benchWindow::eventType type, tileCoord c) {
+				int32_t ev[3] = {type, c.first, c.second};
+				result->eventHash = fnv1a(ev, sizeof(ev), result->eventHash);
+				result->events++;
+			};
+
+			{
+				std::lock_guard<std::mutex> g(mtx);
+				window = std::make_unique<benchWindow>(gridsize, cellsize,
+				                                       benchCacheBytes, cb);
+				popping = !overlap;
+			}
+
+			for (float dist = 0; dist <= length; dist += step) {
+				glm::vec2 pos = path(dist, length);
+				glm::vec2 dir = path(dist + 1.f, length) - pos;
+				dir = dir / std::max(1e-6f, glm::length(dir));
+
+				if (window->setPosition(pos, dir * benchSpeed)) {
+					auto& counts = window->getCounters();
+					ret.dropped += counts.dropped;
+					ret.promoted += counts.promoted;
+				}
+
+				if (overlap) {
+					buildQueued(overlapTiles);
+				} else {
+					drain();
+				}
+			}
+
+			// whatever's left over once the path ends
+			if (overlap) {
+				buildQueued(SIZE_MAX);
+			}
+
+			ret.cacheHits = window->getCacheStats().hits;
+			ret.seconds = msSince(start) / 1000.0;
+			ret.allocations = allocations - startAllocs;
+
+			std::lock_guard<std::mutex> g(mtx);
+			window.reset();
+			result = nullptr;
+			return ret;
+		}
+
+	private:
+		struct finishedTile {
+			tileCoord coord;
+			unsigned serial;
+			unsigned lod;
+			size_t bytes;
+		};
+
+		// hands finished tiles to the window in the same order the
+		// generator uploads them
+		void attach(std::vector<finishedTile>& batch) {
+			while (!batch.empty()) {
+				auto it = batch.begin() + window->nextUpload(batch);
+				window->attach(it->coord, it->serial, it->lod, it->bytes);
+				batch.erase(it);
+			}
+		}
+
+		// waits for the workers to build everything queued
+		void drain(void) {
+			std::vector<finishedTile> batch;
+
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				done.wait(lock, [this] {
+					return busy == 0 && window->getQueue().size() == 0;
+				});
+
+				batch.swap(finished);
+			}
+
+			attach(batch);
+		}
+
+		// builds up to count queued tiles on this thread
+		void buildQueued(size_t count) {
+			std::vector<finishedTile> batch;
+			tileQueue::entry ent;
+
+			while (batch.size() < count && window->getQueue().pop(ent)) {
+				if (!*ent.cancelled) {
+					batch.push_back(build(ent));
+				}
+			}
+
+			attach(batch);
+		}
+
+		void runBands(unsigned count, std::function<void(unsigned)> fn) {
+			auto task = std::make_shared<bandTask>(count, std::move(fn));
+
+			{
+				std::lock_guard<std::mutex> g(mtx);
+				helping.push_back(task);
+			}
+
+			wake.notify_all();
+			task->run();
+
+			std::lock_guard<std::mutex> g(mtx);
+			auto it = std::find(helping.begin(), helping.end(), task);
+			if (it != helping.end()) {
+				helping.erase(it);
+			}
+		}
+
+		// with mtx held
+		bool queued(void) {
+			return popping && window && window->getQueue().size() > 0;
+		}
+
+		void work(void) {
+			while (true) {
+				tileQueue::entry ent;
+
+				{
+					std::unique_lock<std::mutex> lock(mtx);
+					wake.wait(lock, [this] {
+						return stopping || queued() || !helping.empty();
+					});
+
+					if (stopping) {
+						return;
+					}
+
+					// queued tiles first, helping only when there's
+					// nothing else to do
+					if (!queued()) {
+						bandTask::ptr task = helping.back();
+						lock.unlock();
+						while (task->help());
+						lock.lock();
+
+						auto it = std::find(helping.begin(), helping.end(), task);
+						if (it != helping.end()) {
+							helping.erase(it);
+						}
+
+						continue;
+					}
+
+					// popped with the lock held so drain() can't see an
+					// empty queue before this counts as busy
+					if (!window->getQueue().pop(ent)) {
+						continue;
+					}
+
+					busy++;
+				}
+
+				// same as the generator, builds replaced while they were
+				// queued are skipped
+				bool cancelled = *ent.cancelled;
+				finishedTile fin;
+
+				if (!cancelled) {
+					fin = build(ent);
+				}
+
+				std::lock_guard<std::mutex> g(mtx);
+
+				if (!cancelled) {
+					finished.push_back(fin);
+				}
+
+				if (--busy == 0) {
+					done.notify_all();
+				}
+			}
+		}
+
+		finishedTile build(const tileQueue::entry& ent) {
+			auto start = benchClock::now();
+			float unit = lodUnits[ent.lod];
+			tileData data = sampleTile(benchSeed,
+			                           ent.coord.first * cellsize,
+			                           ent.coord.second * cellsize,
+			                           cellsize, unit,
+			                           [this] (unsigned count, auto fn) {
+				                           runBands(count, std::move(fn));
+			                           });
+			double sampleMs = msSince(start);
+			double stageMs[2];
+			uint64_t stageHash[2] = {0, 0};
+
+			// mesh and vegetation only need the samples, same as in the
+			// generator they run side by side on big tiles
+			auto stage = [&] (unsigned stage) {
+				auto stageStart = benchClock::now();
+
+				if (stage == 0) {
+					tileMesh mesh = buildTileMesh(data, skirtDepth);
+
+					if (hashing) {
+						uint64_t h = fnv1a(mesh.positions);
+						h = fnv1a(mesh.normals, h);
+						h = fnv1a(mesh.uvs, h);
+						stageHash[0] = fnv1a(*mesh.indices, h);
+					}
+				} else {
+					// capped the same way the generator caps it
+					unsigned perChunk = grassPerChunk(ent.lod, gridsize,
+					                                  defaultGrassBudget);
+					auto grass = sampleGrass(data, grassChunks, perChunk);
+
+					for (auto& chunk : grass) {
+						stageHash[1] = hashing? fnv1a(chunk.instances, stageHash[1] + 1)
+						                      : 0;
+					}
+				}
+
+				stageMs[stage] = msSince(stageStart);
+			};
+
+			if (data.samples >= 2*minBandRows) {
+				runBands(2, stage);
+			} else {
+				stage(0);
+				stage(1);
+			}
+
+			double buildMs = msSince(start);
+
+			std::lock_guard<std::mutex> g(mtx);
+			result->tiles++;
+			result->sampleMs += sampleMs;
+			result->meshMs += stageMs[0];
+			result->vegetationMs += stageMs[1];
+
+			if (hashing) {
+				uint64_t h = hashTile(data);
+				h = fnv1a(stageHash, sizeof(stageHash), h);
+
+				auto [it, added] = result->hashes.insert({{ent.coord, ent.lod}, h});
+				result->inconsistent += !added && it->second != h;
+			}
+			result->dataBytes += data.bytes();
+			result->buildMs.push_back(buildMs);
+			result->latencyMs.push_back(msSince(crossedAt));
+
+			return {ent.coord, ent.serial, ent.lod, data.bytes()};
+		}
+
+		std::vector<std::thread> workers;
+		// split tiles other workers can help with
+		std::vector<bandTask::ptr> helping;
+
+		std::mutex mtx;
+		std::condition_variable wake;
+		std::condition_variable done;
+		bool stopping = false;
+		benchClock::time_point crossedAt;
+		benchResult *result = nullptr;
+		bool hashing = false;
+
+		// window the path is at, only used from the thread calling run()
+		// apart from its queue. workers only pop tiles from it while
+		// popping is set, and how many they're building and have
+		// finished since the last drain()
+		std::unique_ptr<benchWindow> window;
+		bool popping = false;
+		unsigned busy = 0;
+		std::vector<finishedTile> finished;
+};
+
+static double percentile(std::vector<double> values, double p) {
+	if (values.empty()) {
+		return 0;
+	}
+
+	std::sort(values.begin(), values.end());
+	return values[std::min(values.size() - 1, size_t(p * values.size()))];
+}
+
+static size_t peakRSSKB(void) {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+}
+
+// same tiles on one thread and on threads, anything built differently is
+// a mismatch, as is a tile one run built and the other didn't
+static int verify(benchPath path, const char *name, int cells, int threads,
+                  bool overlap)
+{
+	benchResult single, multi;
+
+	{
+		benchRunner runner(1);
+		single = runner.run(path, cells, true, overlap);
+	}
+
+	{
+		benchRunner runner(threads);
+		multi = runner.run(path, cells, true, overlap);
+	}
+
+	size_t mismatches = single.inconsistent + multi.inconsistent;
+
+	for (auto& [key, hash] : single.hashes) {
+		auto it = multi.hashes.find(key);
+		mismatches += it == multi.hashes.end() || it->second != hash;
+	}
+
+	for (auto& [key, hash] : multi.hashes) {
+		mismatches += single.hashes.count(key) == 0;
+	}
+
+	// the whole event sequence counts as one
+	mismatches += single.events != multi.events
+	              || single.eventHash != multi.eventHash;
+
+	printf("%-10s %-8s %8zu %8zu %8zu %8zu %8zu %8zu %10zu\n",
+	       name, overlap? "overlap" : "wait",
+	       single.hashes.size(), multi.hashes.size(), multi.events,
+	       multi.dropped, multi.promoted, multi.cacheHits,
+	       mismatches);
+	return mismatches? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+	std::string which = (argc > 1)? argv[1] : "all";
+	int cells         = (argc > 2)? atoi(argv[2]) : 64;
+	int threads       = (argc > 3)? atoi(argv[3])
+	                              : std::max(1u, std::thread::hardware_concurrency());
+	cellsize          = (argc > 4)? atof(argv[4]) : cellsize;
+
+	struct { const char *name; benchPath path; } paths[] = {
+		{"straight", straightPath},
+		{"circle",   circlePath},
+		{"zigzag",   zigzagPath},
+	};
+
+	bool known = which == "all" || which == "verify";
+	for (auto& p : paths) {
+		known |= which == p.name;
+	}
+
+	// multiple of the coarsest level, like the generator rounds it
+	cellsize = roundf(cellsize / lodUnits[lodLevels - 1]) * lodUnits[lodLevels - 1];
+
+	if (!known || cells <= 0 || threads <= 0 || cellsize <= 0) {
+		fprintf(stderr, "usage: %s [straight|circle|zigzag|all|verify] [cells] "
+		        "[threads] [cellsize]\n", argv[0]);
+		return 1;
+	}
+
+	if (which == "verify") {
+		// one thread against one thread wouldn't show much
+		threads = std::max(2, threads);
+		int ret = 0;
+
+		printf("%dx%d window of %gm tiles, %d cells of travel, 1 vs %d threads\n",
+		       gridsize, gridsize, cellsize, cells, threads);
+		printf("%-10s %-8s %8s %8s %8s %8s %8s %8s %10s\n",
+		       "path", "moves", "tiles 1", "tiles N", "events", "dropped",
+		       "promoted", "cached", "mismatches");
+
+		for (auto& p : paths) {
+			ret |= verify(p.path, p.name, cells, threads, false);
+			ret |= verify(p.path, p.name, cells, threads, true);
+		}
+
+		printf("%s\n", ret? "FAILED, output depends on threads" : "passed");
+		return ret;
+	}
+
+	printf("%dx%d window of %gm tiles, %d cells of travel, %d threads\n",
+	       gridsize, gridsize, cellsize, cells, threads);
+	printf("%-10s %8s %10s %10s %10s %10s %10s %12s %10s\n",
+	       "path", "tiles", "tiles/s", "build p50", "build p99",
+	       "lat p50", "lat p99", "allocs/tile", "data/tile");
+
+	benchRunner runner(threads);
+	benchResult stages;
+
+	for (auto& p : paths) {
+		if (which != "all" && which != p.name) {
+			continue;
+		}
+
+		benchResult res = runner.run(p.path, cells);
+		stages.tiles += res.tiles;
+		stages.sampleMs += res.sampleMs;
+		stages.meshMs += res.meshMs;
+		stages.vegetationMs += res.vegetationMs;
+		printf("%-10s %8zu %10.1f %10.3f %10.3f %10.3f %10.3f %12.1f %10zu\n",
+		       p.name, res.tiles, res.tiles / res.seconds,
+		       percentile(res.buildMs, 0.5), percentile(res.buildMs, 0.99),
+		       percentile(res.latencyMs, 0.5), percentile(res.latencyMs, 0.99),
+		       res.tiles? double(res.allocations) / res.tiles : 0.0,
+		       res.tiles? res.dataBytes / res.tiles : 0);
+	}
+
+	printf("times in ms, peak RSS %zu KB\n", peakRSSKB());
+	printf("ms per tile by stage: sample %.4f, mesh %.4f, vegetation %.4f\n",
+	       stages.sampleMs / stages.tiles, stages.meshMs / stages.tiles,
+	       stages.vegetationMs / stages.tiles);
+	printf("tile index buffers: %zu\n", tileIndexBuffers());
+	return 0;
+}
@@ -1,6 +1,14 @@
 #include <grend/geometryGeneration.hpp>
 #include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <tuple>
 #include "landscapeGenerator.hpp"
+#include "bandTask.hpp"
+#include "landscapeNoise.hpp"
+#include "landscapeTile.hpp"
+#include "tileLod.hpp"
+#include "tileStore.hpp"
 #include <grend/gameEditor.hpp>
 
 void worldGenerator::setEventQueue(generatorEventQueue::ptr q) {
@@ -13,337 +21,825 @@ void worldGenerator::emit(generatorEvent ev) {
 	}
 }
 
+void worldGenerator::heightsAt(const glm::vec2 *points, size_t count,
+                               float *out)
+{
+	for (size_t i = 0; i < count; i++) {
+		out[i] = heightAt(points[i].x, points[i].y);
+	}
+}
+
 static float thing(float x, float y) {
 	return sin(x) + sin(y);
 }
 
-static glm::vec2 randomGradient(glm::vec2 i) {
-	/*
-	float vx = 3141592623918.0*i.x + 31415926.0 + 1234558198*i.y;
-	float vy = 314159261231.0*i.y + 3141592.0 + 9876598237*i.x;
-	return { cos(vx), sin(vy) };
-	*/
-	float random = 2920.f
-		* sin(i.x * 21942.f + i.y*171324.f + 8912.f)
-		* cos(i.x * 23157.f * i.y*217832.f + 9758.f);
-	return { cos(random), sin(random) };
+// stages in the order they're declared in tileStage, with the stages each
+// one has to wait for. the upload runs on the main thread from update(),
+// everything else on workers
+static const struct {
+	const char *name;
+	unsigned deps;
+} tileStages[] = {
+	{"sample",     0},
+	{"mesh",       1 << landscapeGenerator::stageSample},
+	{"collider",   1 << landscapeGenerator::stageSample},
+	{"vegetation", 1 << landscapeGenerator::stageSample},
+	{"upload",     (1 << landscapeGenerator::stageMesh)
+	               | (1 << landscapeGenerator::stageCollider)
+	               | (1 << landscapeGenerator::stageVegetation)},
+};
+
+static_assert(sizeof(tileStages)/sizeof(tileStages[0])
+              == landscapeGenerator::stageCount);
+
+// loaded once and shared by every generator, see crossedCell()
+static gameModel::ptr grassModel;
+
+static std::atomic<size_t> grassInstances(0);
+static std::atomic<size_t> grassClipped(0);
+
+// grass chunk that takes itself off the instance count once the last
+// tile (shown or cached) using it is gone
+class grassParticles : public gameParticles {
+	public:
+		grassParticles(unsigned count) : gameParticles(count) {}
+
+		virtual ~grassParticles() {
+			grassInstances -= activeInstances;
+		}
+};
+
+const tileData *landscapeGenerator::residentTile(float x, float z) {
+	tileCoord coord = {int(floorf(x / cellsize)), int(floorf(z / cellsize))};
+	const builtTile *tile = window->find(coord);
+
+	return tile? tile->data.get() : nullptr;
 }
 
-static float dotGradient(glm::vec2 i, glm::vec2 pos) {
-	glm::vec2 gradient = randomGradient(i);
-	glm::vec2 dist = pos - i;
+float landscapeGenerator::heightAt(float x, float z) {
+	if (const tileData *data = residentTile(x, z)) {
+		return data->surfaceHeight(x, z);
+	}
 
-	return glm::dot(dist, gradient);
+	return landscapeThing(seed, x, z);
 }
 
-static float perlinNoise(float x, float y) {
-	glm::vec2 pos = { x, y };
-	glm::vec2 grid[2] = {
-		glm::floor(pos),
-		glm::floor(pos) + glm::vec2(1.0)
-	};
-	glm::vec2 weight = pos - grid[0];
-	float n[4];
+void landscapeGenerator::heightsAt(const glm::vec2 *points, size_t count,
+                                   float *out)
+{
+	// anything not on a built tile goes through the noise in one batch
+	std::vector<glm::vec2> missed;
+	std::vector<size_t> missedIdx;
+
+	for (size_t i = 0; i < count; i++) {
+		if (const tileData *data = residentTile(points[i].x, points[i].y)) {
+			out[i] = data->surfaceHeight(points[i].x, points[i].y);
+		} else {
+			missed.push_back(points[i]);
+			missedIdx.push_back(i);
+		}
+	}
 
-	for (unsigned i = 0; i < 4; i++) {
-		n[i] = dotGradient(glm::vec2(grid[!!(i&1)].x, grid[!!(i&2)].y), pos);
+	if (missed.empty()) {
+		return;
 	}
 
-	float ix0 = glm::mix(n[0], n[1], weight.x);
-	float ix1 = glm::mix(n[2], n[3], weight.x);
+	std::vector<float> heights(missed.size());
+	landscapeThingPoints(seed, missed.data(), missed.size(), heights.data());
+
+	for (size_t i = 0; i < missed.size(); i++) {
+		out[missedIdx[i]] = heights[i];
+	}
+}
 
-	return max(0.0, glm::mix(ix0, ix1, weight.y));
+std::string landscapeGenerator::tileName(tileCoord coord) {
+	return config.name + "[" + std::to_string(coord.first) + "]["
+	       + std::to_string(coord.second) + "]";
 }
 
-static float landscapeThing(float x, float y) {
-	auto scalednoise = [](float scale, float x, float y) {
-		return scale*perlinNoise(x / scale, y / scale);
+glm::vec3 landscapeGenerator::tileOrigin(tileCoord coord) {
+	return glm::vec3(coord.first * cellsize, 0, coord.second * cellsize);
+}
+
+generatorEvent landscapeGenerator::tileEvent(generatorEvent::types type,
+                                             tileCoord coord)
+{
+	return (generatorEvent) {
+		.type = type,
+		.position = tileOrigin(coord) + glm::vec3(cellsize*0.5, 0, cellsize*0.5),
+		.extent = glm::vec3(cellsize * 0.5f, HUGE_VALF, cellsize*0.5f),
 	};
+}
+
+static float msSince(std::chrono::steady_clock::time_point start) {
+	auto now = std::chrono::steady_clock::now();
+	return std::chrono::duration<float, std::milli>(now - start).count();
+}
 
-	float a1 = max(0.f, scalednoise(75.f, x, y));
-	float a2 = scalednoise(20.f, x, y);
-	float a3 = scalednoise(5.f,  x, y);
-	float a4 = 0.5*scalednoise(1.f, x, y);
+// rough CPU-side size of a finished tile, for the cache budget. the mesh
+// itself only lives on the GPU once it's been uploaded, see attachTile()
+static size_t tileBytes(const landscapeGenerator::builtTile& built) {
+	gameModel::ptr model = built.model;
+	size_t ret = model->vertices.size() * sizeof(model->vertices[0]);
 
-	return a1 + a2 + a3 + a4;
+	if (auto mesh = std::dynamic_pointer_cast<gameMesh>(model->getNode("mesh"))) {
+		ret += mesh->faces.size() * sizeof(mesh->faces[0]);
+	}
+
+	// trees and grass chunks
+	for (auto& [name, node] : model->nodes) {
+		if (auto parts = std::dynamic_pointer_cast<gameParticles>(node)) {
+			ret += parts->positions.size() * sizeof(parts->positions[0]);
+		}
+	}
+
+	return ret + built.collider->bytes() + built.data->bytes();
 }
 
-static const int   gridsize = 9;
-static const float cellsize = 24.f;
+// CPU-side vertices and indices for tile models, only needed until the
+// model has been uploaded. releaseTileModel() hands them back here for the
+// next tile with the same number of vertices, so a generator that's been
+// running for a bit doesn't allocate any mesh storage
+struct modelStorage {
+	decltype(gameModel::vertices) vertices;
+	decltype(gameMesh::faces) faces;
+};
+
+static const size_t maxPooledModels = 64;
+
+static std::mutex modelPoolMtx;
+static std::map<size_t, std::vector<modelStorage>> modelPool;
+static landscapeGenerator::meshCounters modelCounters = {};
+
+static gameModel::ptr makeTileModel(const tileData& data) {
+	gameModel::ptr model = std::make_shared<gameModel>();
+	gameMesh::ptr mesh = std::make_shared<gameMesh>();
+	unsigned res = data.resolution();
+	size_t count = tileVertexCount(res);
+	modelStorage storage;
+
+	{
+		std::lock_guard<std::mutex> g(modelPoolMtx);
+		auto& pooled = modelPool[count];
+
+		if (pooled.empty()) {
+			modelCounters.allocated++;
+		} else {
+			storage = std::move(pooled.back());
+			pooled.pop_back();
+			modelCounters.pooled--;
+			modelCounters.reused++;
+		}
+	}
+
+	// the engine wants its own copy of the indices, at least it goes
+	// into recycled storage
+	auto indices = tileIndices(res);
+	storage.vertices.resize(count);
+	storage.faces.assign(indices->begin(), indices->end());
+
+	tileVertices(data, skirtDepth,
+		[&] (size_t i, glm::vec3 pos, glm::vec3 n, glm::vec2 uv) {
+			auto& v = storage.vertices[i];
+
+			v.position = pos;
+			v.normal   = n;
+			v.uv       = uv;
+			// u runs along x and v along z, so the tangent is x projected
+			// onto the surface, with the bitangent flipped to point along +z
+			v.tangent  = glm::vec4(glm::normalize(glm::vec3(1, 0, 0) - n*n.x), -1);
+		});
+
+	model->vertices = std::move(storage.vertices);
+	model->haveNormals = true;
+	model->haveTangents = true;
+	mesh->faces = std::move(storage.faces);
+	setNode("mesh", model, mesh);
+	model->genAABBs();
 
-landscapeGenerator::landscapeGenerator(unsigned seed) {
-	// TODO: do something with the seed
+	return model;
 }
 
-void landscapeGenerator::generateLandscape(gameMain *game,
-                                           glm::vec3 curpos,
-                                           glm::vec3 lastpos)
+// takes the CPU-side copy out of an uploaded (or abandoned) tile mesh and
+// keeps it for the next one, anything that needs heights later (colliders,
+// height queries) gets them from tileData
+static void releaseTileModel(gameModel::ptr model) {
+	if (!model) {
+		return;
+	}
+
+	auto mesh = std::dynamic_pointer_cast<gameMesh>(model->getNode("mesh"));
+	modelStorage storage;
+
+	storage.vertices = std::move(model->vertices);
+	model->vertices.clear();
+
+	if (mesh) {
+		storage.faces = std::move(mesh->faces);
+		mesh->faces.clear();
+	}
+
+	if (storage.vertices.empty()) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> g(modelPoolMtx);
+
+	if (modelCounters.pooled < maxPooledModels) {
+		modelPool[storage.vertices.size()].push_back(std::move(storage));
+		modelCounters.pooled++;
+	}
+}
+
+landscapeGenerator::landscapeGenerator()
+	: landscapeGenerator(generatorConfig()) {}
+
+landscapeGenerator::landscapeGenerator(const generatorConfig& conf)
+	: config(conf)
 {
-	static gameModel::ptr models[gridsize][gridsize];
-	static gameModel::ptr temp[gridsize][gridsize];
-	static gameModel::ptr grassmod;
-	// BIG XXX: avoid accessing landscape material shared pointer from multiple
-	//          threads (assignment to mesh material increases use count)
-	static std::mutex landscapemtx;
-
-	if (grassmod == nullptr) {
-		//grassmod = loadScene("./test-assets/obj/crapgrass.glb");
-		//grassmod = loadScene("./test-assets/obj/smoothcube.glb");
-		grassmod = load_object("assets/obj/Prop_Grass_Clump_2.obj");
-		game->jobs->addDeferred([=] {
-			compileModel("grassclump", grassmod);
-			bindModel(grassmod);
-			return true;
-		});
+	float coarsest = lodUnits[lodLevels - 1];
+
+	// every level needs to land exactly on the tile edges
+	config.cellsize = std::max(1.f, roundf(config.cellsize / coarsest)) * coarsest;
+	config.gridsize = std::max(3, config.gridsize | 1);
+
+	while (config.gridsize > 3
+	       && windowBytes(config.gridsize, config.cellsize) > config.memoryBudget)
+	{
+		config.gridsize -= 2;
 	}
 
-	gameObject::ptr ret = std::make_shared<gameObject>();
-	std::list<std::future<bool>> futures;
-
-	glm::vec3 diff = curpos - lastpos;
-	float off = cellsize * (gridsize / 2);
-	SDL_Log("curpos != genpos, diff: (%g, %g, %g)", diff.x, diff.y, diff.z);
-
-	for (int x = 0; x < gridsize; x++) {
-		for (int y = 0; y < gridsize; y++) {
-			int ax = x + diff.x;
-			int ay = y + diff.z;
-
-			if (models[x][y] == nullptr
-			    || ax >= gridsize || ax < 0
-			    || ay >= gridsize || ay < 0)
-			{
-				glm::vec3 coord =
-					(curpos * cellsize)
-					- glm::vec3(off, 0, off)
-					+ glm::vec3(x*cellsize, 0, y*cellsize);
-
-				glm::vec3 prev =
-					(lastpos * cellsize)
-					- glm::vec3(off, 0, off)
-					+ glm::vec3(x*cellsize, 0, y*cellsize);
-
-				if (models[x][y]) {
-					// don't emit delete if there's no model there
-					// (ie. on startup)
-					emit((generatorEvent) {
-							.type = generatorEvent::types::deleted,
-							.position = prev + glm::vec3(cellsize*0.5, 0, cellsize*0.5),
-							.extent = glm::vec3(cellsize * 0.5f, HUGE_VALF, cellsize*0.5f),
-					});
-				}
+	if (config.gridsize != (conf.gridsize | 1) || config.cellsize != conf.cellsize) {
+		SDL_Log("landscapeGenerator: asked for a %dx%d window of %gm tiles, "
+		        "using %dx%d of %gm to fit in %zu bytes",
+		        conf.gridsize, conf.gridsize, conf.cellsize,
+		        config.gridsize, config.gridsize, config.cellsize,
+		        config.memoryBudget);
+	}
 
-				emit((generatorEvent) {
-					.type = generatorEvent::types::generatorStarted,
-					.position = coord + glm::vec3(cellsize*0.5, 0, cellsize*0.5),
-					.extent = glm::vec3(cellsize * 0.5f, HUGE_VALF, cellsize*0.5f),
-				});
-
-				SDL_Log("CCCCCCCC: generating coord (%g, %g)", coord.x, coord.z);
-
-				// TODO: reaaaaallly need to split this up
-				futures.push_back(game->jobs->addAsync([=] {
-					SDL_Log("DDDDDDD: got here, from the future (%g, %g)",
-							coord.x, coord.z);
-					auto ptr = generateHeightmap(cellsize, cellsize, 2.0, coord.x, coord.z, landscapeThing);
-					//auto ptr = generateHeightmap(24, 24, 0.5, coord.x, coord.z, thing);
-					SDL_Log("EEEEEEE: generated model");
-					ptr->transform.position = glm::vec3(coord.x, 0, coord.z);
-
-					gameMesh::ptr mesh =
-						std::dynamic_pointer_cast<gameMesh>(ptr->getNode("mesh"));
-					gameMesh *fug = dynamic_cast<gameMesh*>(ptr->getNode("mesh").get());
-
-					gameMesh *blarg = (gameMesh*)ptr->getNode("mesh").get();
-
-					SDL_Log("EEEEEEE.v2: has node: %d, mesh ptr: %p, source ptr: %p, other? %p, id: %s, blarg: %p",
-						ptr->hasNode("mesh"), mesh.get(),
-						ptr->getNode("mesh").get(), fug, ptr->getNode("mesh")->idString().c_str(), blarg);
-
-					/*
-					if (mesh) {
-						//std::lock_guard<std::mutex> g(landscapemtx);
-						mesh->meshMaterial = std::make_shared<material>();
-						mesh->meshMaterial->factors.diffuse = {0.5, 1.0, 0.5, 1};
-						mesh->meshMaterial->factors.ambient = {1, 1, 1, 1};
-						mesh->meshMaterial->factors.specular = {1, 1, 1, 1};
-						mesh->meshMaterial->factors.emissive = {0, 0, 0, 0};
-						mesh->meshMaterial->factors.roughness = 0.9f;
-						mesh->meshMaterial->factors.metalness = 0.f;
-						mesh->meshMaterial->factors.opacity = 1;
-						mesh->meshMaterial->factors.refract_idx = 1.5;
-					}
-					*/
-					mesh->meshMaterial = landscapeMaterial;
-					std::string name = "gen["+std::to_string(int(x))+"]["+std::to_string(int(y))+"]";
-					SDL_Log("FFFFFFF: setting node");
-
-					gameObject::ptr foo = std::make_shared<gameObject>();
-					setNode("asdfasdf", foo, ptr);
-					SDL_Log("GGGGGGG: Adding landscape mesh to physics");
-
-					auto fut = game->jobs->addDeferred([=]{
-						SDL_Log("HHHHHHH: Generating new landscape model");
-						compileModel(name, ptr);
-						bindModel(ptr);
-						return true;
-					});
-
-					SDL_Log("IIIIIII: generating tree instances");
-					glm::vec2 posgrad = randomGradient(glm::vec2(coord.x, coord.z));
-					float baseElevation = landscapeThing(coord.x, coord.z);
-					int randtrees = (posgrad.x + 1.0)*0.5 * 5 * (1.0 - baseElevation/50.0);
-
-					game->phys->addStaticModels(nullptr, foo, TRS());
-
-					gameParticles::ptr parts = std::make_shared<gameParticles>(32);
-					parts->activeInstances = randtrees;
-					parts->radius = cellsize / 2.f * 1.415;
-
-					for (unsigned i = 0; i < parts->activeInstances; i++) {
-						TRS transform;
-						glm::vec2 pos = randomGradient(glm::vec2(coord.x + i, coord.z + i));
-
-						float tx = ((pos.x + 1)*0.5) * cellsize;
-						float ty = ((pos.y + 1)*0.5) * cellsize;
-
-						transform.position = glm::vec3(
-							tx, landscapeThing(coord.x + tx, coord.z + ty) - 0.1, ty
-						);
-						transform.scale = glm::vec3((posgrad.y + 1.0)*0.5*3.0+0.5);
-						parts->positions[i] = transform.getTransform();
-					}
+	seed = config.seed;
+	gridsize = config.gridsize;
+	cellsize = config.cellsize;
 
-					SDL_Log("JJJJJJJ: adding node instances...");
-					parts->update();
-					setNodeXXX("tree", parts, treeNode);
-					setNodeXXX("parts", ptr, parts);
-					SDL_Log("KKKKKKK: ok cool");
-
-#if 0
-					int randgrass = (posgrad.y*0.5 + 0.5) * 256 * (1.0 - baseElevation/50.0);
-					gameParticles::ptr grass = std::make_shared<gameParticles>(256);
-					grass->activeInstances = randgrass;
-					grass->radius = cellsize * 1.415;
-
-					for (unsigned i = 0; i < grass->activeInstances; i++) {
-						TRS transform;
-						/*
-						glm::vec2 pos = randomGradient(glm::vec2(coord.x + i, coord.z + i));
-
-						float tx = ((pos.x + 1)*0.5) * cellsize;
-						float ty = ((pos.y + 1)*0.5) * cellsize;
-						*/
-						auto fract = [](float n){ return n - floor(n); };
-						glm::vec2 pos(fract(sin(1234567.89*(coord.x + i))), fract(sin(123456789.10*(coord.y + i))));
-
-						float tx = pos.x * cellsize;
-						float ty = pos.y * cellsize;
-
-						transform.position = glm::vec3(
-							tx, landscapeThing(coord.x + tx, coord.z + ty), ty
-						);
-						//transform.scale = glm::vec3((posgrad.y + 1.0)*0.5*3.0+0.5);
-						grass->positions[i] = transform.getTransform();
-					}
+	modelWindow::callbacks cb;
+	cb.crossed = [this] (tileCoord c) { crossedCell(c); };
+	cb.show = [this] (tileCoord c, const builtTile& built, bool replacing) {
+		showTile(c, built, replacing);
+	};
+	cb.hide = [this] (tileCoord c, const builtTile& built) { hideTile(c, built); };
+	cb.bytes = tileBytes;
 
-					grass->update();
-					setNodeXXX("grass", grass, grassmod);
-					setNodeXXX("grassparts", ptr, grass);
-
-					int randlight = (posgrad.y + 1.0)*0.5 * 7 * (1.0 - baseElevation/50.0);
-
-					for (int i = 0; i < randlight; i++) {
-						gameLightPoint::ptr nlit = std::make_shared<gameLightPoint>();
-						glm::vec2 pos = randomGradient(glm::vec2(2*coord.x + i, 2*coord.z + i));
-
-						float tx = ((pos.x + 1)*0.5) * cellsize;
-						float ty = ((pos.y + 1)*0.5) * cellsize;
-
-						glm::vec3 colors[6] = {
-							{1.0, 0.5, 0.2},
-							{1.0, 0.2, 0.5},
-							{0.5, 1.0, 0.2},
-							{0.5, 0.2, 1.0},
-							{0.2, 1.0, 0.5},
-							{0.2, 0.5, 1.0},
-						};
-
-						nlit->radius = 0.30;
-						nlit->intensity = 500.0;
-						nlit->diffuse = glm::vec4(colors[rand() % 6], 1.0);
-						nlit->transform.position = glm::vec3(
-							tx, landscapeThing(coord.x + tx, coord.z + ty) + 1.5, ty
-						);
-
-						std::string name = "point["+std::to_string(i)+"]";
-						setNodeXXX(name, ptr, nlit);
-					}
-#endif
+	cb.event = [this] (modelWindow::eventType type, tileCoord c) {
+		static const generatorEvent::types types[] = {
+			generatorEvent::types::generatorStarted,
+			generatorEvent::types::generated,
+			generatorEvent::types::deleted,
+		};
 
-					temp[x][y] = ptr;
-					fut.wait();
-					return true;
-				}));
+		emit(tileEvent(types[type], c));
+	};
 
-				emit((generatorEvent) {
-					.type = generatorEvent::types::generated,
-					.position = coord + glm::vec3(cellsize*0.5, 0, cellsize*0.5),
-					.extent = glm::vec3(cellsize*0.5f, HUGE_VALF, cellsize*0.5f),
-				});
+	// one job per queued tile, but which tile a job builds is decided
+	// when it starts running
+	cb.queued = [this] {
+		gameMain *game = activeGame;
+		jobs.push_back(game->jobs->addAsync([=] {
+			return runQueuedTile(game);
+		}));
+	};
 
-			} else {
-				temp[x][y] = models[ax][ay];
-			}
+	window = std::make_unique<modelWindow>(gridsize, cellsize,
+	                                       config.cacheBytes, std::move(cb));
+}
+
+landscapeGenerator::grassCounters landscapeGenerator::getGrassStats(void) {
+	return {
+		.instances = grassInstances,
+		.clipped   = grassClipped,
+	};
+}
+
+landscapeGenerator::meshCounters landscapeGenerator::getMeshStats(void) {
+	std::lock_guard<std::mutex> g(modelPoolMtx);
+	meshCounters ret = modelCounters;
+
+	ret.indexBuffers = tileIndexBuffers();
+	return ret;
+}
+
+size_t landscapeGenerator::windowBytes(int size, float cell) {
+	size_t ret = 0;
+	size_t grass = 0;
+	int half = size / 2;
+
+	for (int x = -half; x <= half; x++) {
+		for (int y = -half; y <= half; y++) {
+			unsigned lod = tileLod({x, y}, {0, 0});
+			size_t res = cell/lodUnits[lod] + 1;
+			// grid plus skirts, see buildTileMesh()
+			size_t verts = res*res + 4*(res - 1);
+			size_t indices = 6*(res - 1)*(res - 1) + 24*(res - 1);
+			size_t mesh = verts*sizeof(gameModel::vertex) + indices*sizeof(uint32_t);
+
+			// the mesh on the GPU, plus tree instances (worst case,
+			// most tiles have a lot less), the heightfield collider
+			// and the packed samples kept for height queries
+			ret += mesh + maxTileTrees(cell)*sizeof(glm::mat4)
+			     + res*res*sizeof(int16_t)
+			     + res*res*(sizeof(int16_t) + sizeof(uint16_t));
+			grass += grassChunks*grassChunks*lodGrass[lod];
 		}
 	}
 
-	for (auto& fut : futures) {
-		fut.wait();
+	return ret + std::min(grass, config.grassBudget)*sizeof(glm::mat4);
+}
+
+void landscapeGenerator::openTileStore(std::string path, size_t maxBytes) {
+	store = std::make_shared<tileStore>(path, maxBytes);
+
+	if (!store->isOpen()) {
+		store = nullptr;
+	}
+}
+
+bool landscapeGenerator::runQueuedTile(gameMain *game) {
+	tileQueue::entry ent;
+
+	// nothing left to do if the tile this job was submitted for has since
+	// been dropped from the queue
+	if (!window->getQueue().pop(ent) || *ent.cancelled) {
+		return false;
 	}
 
-	auto meh = game->jobs->addDeferred([&] {
-		for (int x = 0; x < gridsize; x++) {
-			for (int y = 0; y < gridsize; y++) {
-				models[x][y] = temp[x][y];
-				temp[x][y] = nullptr;
-				std::string name = "gen["+std::to_string(int(x))+"]["+std::to_string(int(y))+"]";
-				setNode(name, ret, models[x][y]);
+	glm::vec3 origin = tileOrigin(ent.coord);
+	float unit = lodUnits[ent.lod];
+	auto data = std::make_shared<tileData>();
+	tileStore::key key = {
+		seed, ent.coord.first, ent.coord.second,
+		unsigned(cellsize/unit) + 1, cellsize
+	};
+
+	generatedTile gen;
+
+	auto runStage = [&] (unsigned stage) {
+		auto start = std::chrono::steady_clock::now();
+
+		switch (stage) {
+			case stageSample:
+				// reuse stored tiles from earlier sessions if there are
+				// any, big tiles are sampled in bands that idle workers
+				// can help with
+				if (!store || !store->load(key, origin.x, origin.z, unit, *data)) {
+					*data = sampleTile(seed, origin.x, origin.z, cellsize, unit,
+						[&] (unsigned count, std::function<void(unsigned)> fn) {
+							runShared(game, count, std::move(fn));
+						});
+
+					if (store) {
+						store->save(key, *data);
+					}
+				}
+
+				gen.data = data;
+				break;
+
+			case stageMesh:       buildMesh(gen); break;
+			case stageCollider:   buildCollider(gen); break;
+			case stageVegetation: buildVegetation(gen, ent.lod); break;
+		}
+
+		timeStage(tileStage(stage), msSince(start));
+	};
+
+	// everything but the upload, in waves of stages whose dependencies
+	// are done. stages in the same wave don't touch each other's results
+	// and run side by side if there are idle workers, for tiles that are
+	// big enough for it to be worth handing work around
+	unsigned done = 1 << stageUpload;
+
+	while (done != (1u << stageCount) - 1) {
+		std::vector<unsigned> wave;
+
+		for (unsigned i = 0; i < stageCount; i++) {
+			if (!(done & (1 << i)) && (tileStages[i].deps & ~done) == 0) {
+				wave.push_back(i);
 			}
 		}
 
-		return true;
-	});
-	meh.wait();
+		if (*ent.cancelled) {
+			releaseTileModel(gen.model);
+			return false;
+		}
 
-	/*
-	auto fut = game->jobs->addDeferred([&] {
-		//bindCookedMeshes();
-		return true;
-	});
+		if (done & (1 << stageSample) && data->samples >= 2*minBandRows) {
+			runShared(game, wave.size(), [&] (unsigned i) { runStage(wave[i]); });
+
+		} else for (unsigned stage : wave) {
+			runStage(stage);
+		}
+
+		for (unsigned i : wave) {
+			done |= 1 << i;
+		}
+	}
+
+	// uploaded from update(), a few per frame
+	std::lock_guard<std::mutex> g(uploadMtx);
+	uploads.push_back({ent.coord, ent.serial, ent.lod, std::move(gen)});
+	return true;
+}
+
+void landscapeGenerator::runShared(gameMain *game, unsigned count,
+                                   std::function<void(unsigned)> fn)
+{
+	if (count == 1) {
+		fn(0);
+		return;
+	}
+
+	// only worth asking for help when there aren't enough queued tiles
+	// to keep everyone busy, helpers that show up late return right away
+	auto task = std::make_shared<bandTask>(count, std::move(fn));
+	size_t idle = std::max(1u, std::thread::hardware_concurrency()) - 1;
+	size_t queued = window->getQueue().size();
+	size_t helpers = (queued < idle)? std::min<size_t>(count - 1, idle - queued) : 0;
+
+	for (size_t i = 0; i < helpers; i++) {
+		game->jobs->addAsync([task] {
+			while (task->help());
+			return true;
+		});
+	}
+
+	task->run();
+}
+
+void landscapeGenerator::timeStage(tileStage stage, float ms) {
+	stageMicros[stage] += uint64_t(ms * 1000.f);
+	stageRuns[stage]++;
+}
+
+landscapeGenerator::stageTimes landscapeGenerator::getStageTimes(void) {
+	stageTimes ret;
+
+	for (unsigned i = 0; i < stageCount; i++) {
+		ret.ms[i] = stageMicros[i] / 1000.f;
+		ret.runs[i] = stageRuns[i];
+	}
 
-	fut.wait();
+	return ret;
+}
+
+const char *landscapeGenerator::stageName(tileStage stage) {
+	return (stage < stageCount)? tileStages[stage].name : "unknown";
+}
+
+void landscapeGenerator::buildCollider(generatedTile& gen) {
+	// otherwise made from the model in attachTile()
+	if (config.heightfieldColliders) {
+		auto start = std::chrono::steady_clock::now();
+		gen.collider = makeHeightfieldCollider(*gen.data);
+		gen.colliderMs = msSince(start);
+	}
+}
+
+void landscapeGenerator::buildMesh(generatedTile& gen) {
+	auto& data = gen.data;
+	glm::vec3 coord = glm::vec3(data->x, 0, data->z);
+
+	// heights were already sampled in one batched pass (or loaded from
+	// the tile store), the mesh is built straight from them rather than
+	// going through generateHeightmap(), which has no way to add skirts
+	//auto ptr = generateHeightmap(24, 24, 0.5, coord.x, coord.z, thing);
+	auto ptr = makeTileModel(*data);
+	ptr->transform.position = glm::vec3(coord.x, 0, coord.z);
+
+	gameMesh::ptr mesh =
+		std::dynamic_pointer_cast<gameMesh>(ptr->getNode("mesh"));
+
+	/*
+	if (mesh) {
+		//std::lock_guard<std::mutex> g(landscapemtx);
+		mesh->meshMaterial = std::make_shared<material>();
+		mesh->meshMaterial->factors.diffuse = {0.5, 1.0, 0.5, 1};
+		mesh->meshMaterial->factors.ambient = {1, 1, 1, 1};
+		mesh->meshMaterial->factors.specular = {1, 1, 1, 1};
+		mesh->meshMaterial->factors.emissive = {0, 0, 0, 0};
+		mesh->meshMaterial->factors.roughness = 0.9f;
+		mesh->meshMaterial->factors.metalness = 0.f;
+		mesh->meshMaterial->factors.opacity = 1;
+		mesh->meshMaterial->factors.refract_idx = 1.5;
+	}
 	*/
-	returnValue = ret;
+	mesh->meshMaterial = landscapeMaterial;
+
+	gen.model = ptr;
 }
 
-void landscapeGenerator::setPosition(gameMain *game, glm::vec3 position) {
-	glm::vec3 curpos = glm::floor((glm::vec3(1, 0, 1)*position)/cellsize);
+void landscapeGenerator::buildVegetation(generatedTile& gen, unsigned lod) {
+	auto& data = gen.data;
+
+	// instance buffer sized to what's actually there, tiles above the
+	// tree line don't get one at all
+	gameParticles::ptr parts = nullptr;
+
+	if (!data->trees.empty()) {
+		parts = std::make_shared<gameParticles>(data->trees.size());
+		parts->activeInstances = data->trees.size();
+		parts->radius = cellsize / 2.f * 1.415;
+
+		for (unsigned i = 0; i < parts->activeInstances; i++) {
+			TRS transform;
+			glm::vec4 tree = data->trees[i];
+			// stored heights are off the full detail surface, coarser
+			// tiles would have trees floating or sunk into the ground.
+			// same 10cm into the ground sampleTrees() gives them
+			float y = data->surfaceHeight(data->x + tree.x, data->z + tree.z) - 0.1f;
+
+			transform.position = glm::vec3(tree.x, y, tree.z);
+			transform.scale = glm::vec3(tree.w);
+			parts->positions[i] = transform.getTransform();
+		}
 
-	if (genjob.valid() && genjob.wait_for(std::chrono::milliseconds(0)) == std::future_status::ready) {
-		genjob.get();
-		setNode("nodes", root, returnValue);
-		returnValue = nullptr;
+		parts->update();
+		setNodeXXX("tree", parts, treeNode);
 	}
 
-	if (!genjob.valid() && curpos != lastPosition) {
-		SDL_Log("BBBBBBBBBB: starting new generator job");
-		glm::vec3 npos = lastPosition;
-		lastPosition = curpos;
+	// grass thins out with distance, it's rebuilt along with the tile
+	// when it changes rings. chunks are positioned at their centers so
+	// the radius can be tight enough to cull them one by one
+	unsigned perChunk = grassPerChunk(lod, gridsize, config.grassBudget);
+	grassClipped += (lodGrass[lod] - perChunk) * grassChunks*grassChunks;
+
+	for (auto& chunk : sampleGrass(*data, grassChunks, perChunk)) {
+		size_t count = chunk.instances.size();
+
+		if (count == 0) {
+			continue;
+		}
+
+		glm::vec3 center = (chunk.min + chunk.max) * 0.5f;
+		auto grass = std::make_shared<grassParticles>(count);
+		grass->activeInstances = count;
+		grassInstances += count;
+		grass->transform.position = center;
+		// plus a bit for the size of the clumps themselves
+		grass->radius = glm::length(chunk.max - chunk.min)*0.5f + 1.f;
+
+		for (unsigned i = 0; i < count; i++) {
+			TRS transform;
+			glm::vec4 inst = chunk.instances[i];
+
+			transform.position = glm::vec3(inst.x, inst.y, inst.z) - center;
+			transform.scale = glm::vec3(inst.w);
+			grass->positions[i] = transform.getTransform();
+		}
+
+		grass->update();
+		setNodeXXX("grass", grass, grassModel);
+		gen.grass.push_back(grass);
+	}
+
+	gen.trees = parts;
+}
+
+void landscapeGenerator::attachTile(gameMain *game,
+                                    tileCoord coord,
+                                    unsigned serial,
+                                    unsigned lod,
+                                    generatedTile gen)
+{
+	// tile left the window (or was requeued) while it was being generated
+	if (!window->wanted(coord, serial)) {
+		releaseTileModel(gen.model);
+		return;
+	}
 
-		genjob = game->jobs->addAsync([=] {
-			generateLandscape(game, curpos, npos);
+	builtTile built;
+	built.model = gen.model;
+	built.data = gen.data;
+
+	compileModel(tileName(coord), gen.model);
+	bindModel(gen.model);
+
+	// falls back to a mesh collider if the physics backend can't do
+	// heightfields, it's added to the world once the tile is shown
+	auto start = std::chrono::steady_clock::now();
+
+	if (!gen.collider || !heightfieldsSupported(game)) {
+		gen.collider = makeMeshCollider(gen.model);
+	}
+
+	built.collider = gen.collider;
+	// the mesh collider copies what it needs, so this has to come after
+	releaseTileModel(gen.model);
+	stats.collidersBuilt++;
+	stats.colliderMsTotal += gen.colliderMs + msSince(start);
+	stats.colliderBytesTotal += built.collider->bytes();
+
+	if (stats.collidersBuilt % 64 == 0) {
+		SDL_Log("landscapeGenerator: %s colliders, %gms and %zu bytes per tile",
+		        built.collider->kind(),
+		        stats.colliderMsTotal / stats.collidersBuilt,
+		        stats.colliderBytesTotal / stats.collidersBuilt);
+	}
+
+	if (gen.trees) {
+		setNodeXXX("parts", gen.model, gen.trees);
+	}
+
+	for (size_t i = 0; i < gen.grass.size(); i++) {
+		setNodeXXX("grass[" + std::to_string(i) + "]", gen.model, gen.grass[i]);
+	}
+
+	// shown right away if it's in the window, prefetched tiles are
+	// shown when the player actually gets there
+	window->attach(coord, serial, lod, built);
+}
+
+void landscapeGenerator::showTile(tileCoord coord,
+                                  const builtTile& built,
+                                  bool replacing)
+{
+	gameMain *game = activeGame;
+
+	// new, cached and prefetched tiles all get their colliders added here,
+	// and only tiles in the window have them in the physics world
+	auto start = std::chrono::steady_clock::now();
+	built.collider->attach(game);
+	stats.colliderMsTotal += msSince(start);
+
+	// a different level of detail replacing the old one drops the
+	// old collider, which would otherwise stick out through the new surface
+	setNode(tileName(coord), root, built.model);
+	stats.tilesPending = window->getCounters().pending;
+
+	if (replacing) {
+		return;
+	}
+
+	if (!stats.firstTileShown) {
+		stats.firstTileShown = true;
+		stats.firstTileMs = msSince(crossedAt);
+	}
+
+	if (!stats.groundShown
+	    && coord == window->getCenter())
+	{
+		stats.groundShown = true;
+		stats.groundMs = msSince(crossedAt);
+		stats.groundMsMax = std::max(stats.groundMsMax, stats.groundMs);
+	}
+
+	if (stats.tilesPending == 0) {
+		stats.lastTileMs = msSince(crossedAt);
+		auto counts = terrainCollider::getCounters();
+
+		SDL_Log("landscapeGenerator: window complete, ground under player "
+		        "after %gms, first tile after %gms, last tile after %gms",
+		        stats.groundMs, stats.firstTileMs, stats.lastTileMs);
+		SDL_Log("landscapeGenerator: at most %gms of uploads in one frame",
+		        stats.uploadMsMax);
+		SDL_Log("landscapeGenerator: %zu terrain colliders in the world, "
+		        "%zu alive, %d physics objects in total",
+		        counts.attached, counts.alive, physicsObjectCount(game));
+
+		auto grass = getGrassStats();
+		SDL_Log("landscapeGenerator: %zu grass instances, %zu spots left "
+		        "out over budget so far", grass.instances, grass.clipped);
+
+		auto meshes = getMeshStats();
+		SDL_Log("landscapeGenerator: %zu tile meshes allocated, %zu reused",
+		        meshes.allocated, meshes.reused);
+
+		auto times = getStageTimes();
+		std::string perStage;
+
+		for (unsigned i = 0; i < stageCount; i++) {
+			char buf[64];
+			snprintf(buf, sizeof(buf), " %s %.3f", tileStages[i].name,
+			         times.runs[i]? times.ms[i] / times.runs[i] : 0.f);
+			perStage += buf;
+		}
+
+		SDL_Log("landscapeGenerator: ms per tile by stage:%s", perStage.c_str());
+
+		if (eventQueue) {
+			auto events = eventQueue->getCounters();
+			SDL_Log("landscapeGenerator: %zu events emitted, %zu emits had "
+			        "to retry", events.emitted, events.retries);
+		}
+	}
+}
+
+void landscapeGenerator::hideTile(tileCoord coord, const builtTile& built) {
+	// the window keeps it in its cache in case the player comes back, the
+	// collider comes out of the physics world but is kept with the tile
+	// so it doesn't need to be built again
+	root->nodes.erase(tileName(coord));
+	built.collider->detach();
+}
+
+void landscapeGenerator::crossedCell(tileCoord center) {
+	SDL_Log("landscapeGenerator: entered cell (%d, %d)", center.first, center.second);
+	lastPosition = glm::vec3(center.first, 0, center.second);
+
+	// before anything is queued, tiles are built with it on the workers
+	if (grassModel == nullptr) {
+		//grassModel = loadScene("./test-assets/obj/crapgrass.glb");
+		//grassModel = loadScene("./test-assets/obj/smoothcube.glb");
+		grassModel = load_object("assets/obj/Prop_Grass_Clump_2.obj");
+		activeGame->jobs->addDeferred([=] {
+			compileModel("grassclump", grassModel);
+			bindModel(grassModel);
 			return true;
 		});
 	}
+
+	// forget about finished jobs
+	for (auto it = jobs.begin(); it != jobs.end();) {
+		if (it->wait_for(std::chrono::milliseconds(0)) == std::future_status::ready) {
+			it = jobs.erase(it);
+		} else {
+			it++;
+		}
+	}
+
+	crossedAt = std::chrono::steady_clock::now();
+	stats.firstTileShown = false;
+	stats.uploadMsMax = 0;
+}
+
+void landscapeGenerator::update(gameMain *game) {
+	auto start = std::chrono::steady_clock::now();
+	unsigned uploaded = 0;
+
+	activeGame = game;
+
+
+	while (uploaded == 0 || msSince(start) < config.uploadBudgetMs) {
+		pendingUpload up;
+
+		{
+			std::lock_guard<std::mutex> g(uploadMtx);
+
+			if (uploads.empty()) {
+				break;
+			}
+
+			// same order tiles are built in
+			auto best = uploads.begin() + window->nextUpload(uploads);
+			up = std::move(*best);
+			uploads.erase(best);
+		}
+
+		auto attachStart = std::chrono::steady_clock::now();
+		attachTile(game, up.coord, up.serial, up.lod, std::move(up.gen));
+		timeStage(stageUpload, msSince(attachStart));
+		uploaded++;
+	}
+
+	stats.uploadMs = msSince(start);
+	std::lock_guard<std::mutex> g(uploadMtx);
+	stats.uploadsQueued = uploads.size();
+	stats.uploadMsMax = std::max(stats.uploadMsMax, stats.uploadMs);
+}
+
+void landscapeGenerator::setPosition(gameMain *game,
+                                     glm::vec3 position,
+                                     glm::vec3 velocity)
+{
+	activeGame = game;
+
+	if (!window->setPosition(glm::vec2(position.x, position.z),
+	                         glm::vec2(velocity.x, velocity.z)))
+	{
+		return;
+	}
+
+	auto& counts = window->getCounters();
+	stats.tilesPending = counts.pending;
+	stats.tilesDropped = counts.dropped;
+	stats.tilesCancelled = counts.cancelled;
+	stats.tilesPromoted = counts.promoted;
+	stats.tilesPromotedReady = counts.promotedReady;
+
+	// cached and prefetched tiles may have already covered it
+	stats.groundShown = window->isShown(window->getCenter());
+	stats.groundMs = 0;
+
+	if (stats.tilesDropped || stats.tilesCancelled) {
+		SDL_Log("landscapeGenerator: dropped %u queued tiles, cancelled %u",
+		        stats.tilesDropped, stats.tilesCancelled);
+	}
+
+	if (stats.tilesPromoted) {
+		SDL_Log("landscapeGenerator: promoted %u prefetched tiles, %u were ready",
+		        stats.tilesPromoted, stats.tilesPromotedReady);
+	}
+
+	if (counts.relevelled) {
+		SDL_Log("landscapeGenerator: rebuilding %u tiles at a new level of detail",
+		        counts.relevelled);
+	}
 }
@@ -6,6 +6,20 @@
 #include <grend/ecs/ecs.hpp>
 #include <grend/ecs/collision.hpp>
 #include <thread>
+#include <chrono>
+#include <future>
+#include <map>
+#include <list>
+#include <atomic>
+#include <algorithm>
+
+#include "tileQueue.hpp"
+#include "tileLod.hpp"
+#include "tileWindow.hpp"
+#include "terrainCollider.hpp"
+
+struct tileData;
+class tileStore;
 
 using namespace grendx;
 using namespace grendx::ecs;
@@ -23,34 +37,92 @@ struct generatorEvent {
 	glm::vec3 extent;
 };
 
+// any number of threads can emit without taking a lock, events go onto a
+// linked list with a compare-and-swap. the consumer swaps the whole list
+// out in one go and handles it from its own buffer, so emitters never wait
+// on whatever the handlers are doing
 class generatorEventQueue {
 	public:
 		typedef std::shared_ptr<generatorEventQueue> ptr;
 		typedef std::weak_ptr<generatorEventQueue>   weakptr;
 
-		std::lock_guard<std::mutex> lock(void) {
-			return std::lock_guard<std::mutex>(mtx);
-		}
+		struct counters {
+			size_t emitted;
+			// times an emit had to retry because another thread
+			// got in first, the only place emitters can contend
+			size_t retries;
+			size_t drains;
+		};
 
-		std::vector<generatorEvent>& getQueue(void) {
-			return queue;
+		~generatorEventQueue() {
+			freeList(head.exchange(nullptr));
 		}
 
 		void emit(generatorEvent ev) {
-			std::lock_guard<std::mutex> g(mtx);
-			queue.push_back(ev);
+			node *n = new node {ev, head.load(std::memory_order_relaxed)};
+
+			while (!head.compare_exchange_weak(n->next, n,
+			                                   std::memory_order_release,
+			                                   std::memory_order_relaxed))
+			{
+				retries.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			emitted.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// everything emitted so far, oldest first, replacing what was
+		// in out. only one thread should be draining
+		void drain(std::vector<generatorEvent>& out) {
+			node *list = head.exchange(nullptr, std::memory_order_acquire);
+			out.clear();
+
+			for (node *n = list; n; n = n->next) {
+				out.push_back(n->ev);
+			}
+
+			// the list is newest first
+			std::reverse(out.begin(), out.end());
+			freeList(list);
+			drains++;
+		}
+
+		counters getCounters(void) {
+			return {emitted, retries, drains};
 		}
 
 	private:
-		std::mutex mtx;
-		std::vector<generatorEvent> queue;
+		struct node {
+			generatorEvent ev;
+			node *next;
+		};
+
+		static void freeList(node *n) {
+			while (n) {
+				node *next = n->next;
+				delete n;
+				n = next;
+			}
+		}
+
+		std::atomic<node*> head = nullptr;
+		std::atomic<size_t> emitted = 0;
+		std::atomic<size_t> retries = 0;
+		size_t drains = 0;
 };
 
 class worldGenerator {
 	public:
 		virtual gameObject::ptr getNode(void) { return root; };
-		virtual void setPosition(gameMain *game, glm::vec3 position) = 0;
+		// velocity is used to guess where the player is headed, if the
+		// generator cares
+		virtual void setPosition(gameMain *game, glm::vec3 position,
+		                         glm::vec3 velocity = glm::vec3(0)) = 0;
 		virtual void setEventQueue(generatorEventQueue::ptr q);
+		// terrain height at a world position, and the same for a batch
+		// of (x, z) points. main thread only
+		virtual float heightAt(float x, float z) = 0;
+		virtual void heightsAt(const glm::vec2 *points, size_t count, float *out);
 
 	protected:
 		// TODO: generic event class
@@ -63,13 +135,225 @@ class worldGenerator {
 
 class landscapeGenerator : public worldGenerator {
 	public:
-		landscapeGenerator(unsigned seed = 0xcafebabe);
-		virtual void setPosition(gameMain *game, glm::vec3 position);
+		struct generatorConfig {
+			uint32_t seed = 0xcafebabe;
+			// tiles per side of the view window, rounded up to an odd
+			// number, and the size of a tile in meters, rounded to a
+			// multiple of the coarsest sample spacing
+			int gridsize = 9;
+			float cellsize = 24.f;
+			// the window is shrunk until the estimated size of a full
+			// window of tiles fits in this
+			size_t memoryBudget = 64*1024*1024;
+			// evicted tiles are kept around up to this many bytes
+			size_t cacheBytes = 16*1024*1024;
+			// prefix for tile node and model names, generators running
+			// side by side need different names
+			std::string name = "gen";
+			// heightfield colliders instead of triangle meshes, when
+			// the physics backend supports them
+			bool heightfieldColliders = true;
+			// grass instances in a full window of tiles. if the
+			// window would have more, every tile gets less by the
+			// same factor for its level of detail, see grassPerChunk()
+			size_t grassBudget = defaultGrassBudget;
+			// main thread time spent uploading finished tiles per
+			// frame, at least one tile goes up each frame regardless
+			float uploadBudgetMs = 2.f;
+		};
+
+		struct generatorStats {
+			// time from crossing into a new cell until the first/last tile
+			// of the new window became visible
+			float firstTileMs = 0;
+			float lastTileMs  = 0;
+			bool firstTileShown = false;
+			unsigned tilesPending = 0;
+			// time from crossing into a new cell until there was a tile
+			// under the player, zero if it was already there, and the
+			// worst case so far
+			float groundMs = 0;
+			float groundMsMax = 0;
+			bool groundShown = false;
+			// queued tiles dropped before they started, and tiles
+			// abandoned partway through, since the last move
+			unsigned tilesDropped = 0;
+			unsigned tilesCancelled = 0;
+			// tiles in the new window that were already prefetched,
+			// and how many of those were finished
+			unsigned tilesPromoted = 0;
+			unsigned tilesPromotedReady = 0;
+			// totals over every collider built so far, the time
+			// includes building the shape and adding it to the world
+			unsigned collidersBuilt = 0;
+			float colliderMsTotal = 0;
+			size_t colliderBytesTotal = 0;
+			// finished tiles waiting to be uploaded after this frame,
+			// time spent uploading this frame, and the most spent in
+			// one frame since the last move
+			unsigned uploadsQueued = 0;
+			float uploadMs = 0;
+			float uploadMsMax = 0;
+		};
+
+		// terrain colliders across every generator, only the ones for
+		// tiles in a view window should be attached
+		terrainCollider::counters getColliderStats(void) {
+			return terrainCollider::getCounters();
+		}
+
+		struct grassCounters {
+			// instances alive across every generator (shown or
+			// cached), and spots left out because of the budget
+			// before any were thinned out by density
+			size_t instances;
+			size_t clipped;
+		};
+
+		static grassCounters getGrassStats(void);
+
+		// stages every tile goes through, see tileStages in the .cpp for
+		// what each of them waits on
+		enum tileStage : unsigned {
+			stageSample,
+			stageMesh,
+			stageCollider,
+			stageVegetation,
+			stageUpload,
+			stageCount,
+		};
+
+		struct stageTimes {
+			// time spent in each stage over every tile so far, and
+			// how many times it ran
+			float ms[stageCount];
+			unsigned runs[stageCount];
+		};
+
+		stageTimes getStageTimes(void);
+		static const char *stageName(tileStage stage);
+		struct meshCounters {
+			// tile models across every generator whose vertex and
+			// index storage was allocated vs. taken from models that
+			// were already uploaded, storage waiting to be reused,
+			// and shared index buffers (one per resolution)
+			size_t allocated;
+			size_t reused;
+			size_t pooled;
+			size_t indexBuffers;
+		};
+
+		static meshCounters getMeshStats(void);
+
+		// a tile that's ready to be shown, either freshly attached or
+		// coming back out of the cache
+		struct builtTile {
+			gameModel::ptr model;
+			terrainCollider::ptr collider;
+			// sampled heights, kept for height queries
+			std::shared_ptr<const tileData> data;
+		};
+
+		typedef tileWindow<builtTile> modelWindow;
+
+		landscapeGenerator();
+		landscapeGenerator(const generatorConfig& conf);
+		virtual void setPosition(gameMain *game, glm::vec3 position,
+		                         glm::vec3 velocity = glm::vec3(0));
+		// uploads finished tiles, within the frame budget. call once
+		// per frame from the main thread
+		void update(gameMain *game);
+		// uses the heights of shown or staged tiles where there are
+		// any, otherwise samples the noise
+		virtual float heightAt(float x, float z);
+		virtual void heightsAt(const glm::vec2 *points, size_t count, float *out);
+		const generatorStats& getStats(void) { return stats; }
+		// settings actually in use, after rounding and clamping
+		const generatorConfig& getConfig(void) { return config; }
+		// estimated CPU and GPU size of a full window of tiles
+		size_t windowBytes(int gridsize, float cellsize);
+
+		// evicted tiles are kept around up to this many bytes
+		void setCacheBudget(size_t bytes) { window->setCacheBudget(bytes); }
+		const modelWindow::cacheCounters& getCacheStats(void) {
+			return window->getCacheStats();
+		}
+
+		// generated tiles are written to (and looked up in) a file at path,
+		// which stops growing past maxBytes
+		void openTileStore(std::string path, size_t maxBytes = 256*1024*1024);
+		std::shared_ptr<tileStore> getTileStore(void) { return store; }
 
 	private:
-		void generateLandscape(gameMain *game, glm::vec3 curpos, glm::vec3 lastpos);
-		std::future<bool> genjob;
-		gameObject::ptr returnValue;
+		struct generatedTile {
+			gameModel::ptr model;
+			gameParticles::ptr trees;
+			std::vector<gameParticles::ptr> grass;
+			std::shared_ptr<const tileData> data;
+			// built on the worker when using heightfields, otherwise
+			// made from the model in attachTile()
+			terrainCollider::ptr collider;
+			float colliderMs = 0;
+		};
+
+		// finished on a worker, waiting for the main thread
+		struct pendingUpload {
+			tileCoord coord;
+			unsigned serial;
+			unsigned lod;
+			generatedTile gen;
+		};
+
+		// runs on worker threads
+		bool runQueuedTile(gameMain *game);
+		// worker stages, see runQueuedTile()
+		void buildMesh(generatedTile& gen);
+		void buildVegetation(generatedTile& gen, unsigned lod);
+		void buildCollider(generatedTile& gen);
+		// runs fn(0) .. fn(count - 1) on this thread, with help from idle
+		// workers if there are any
+		void runShared(gameMain *game, unsigned count,
+		               std::function<void(unsigned)> fn);
+		void timeStage(tileStage stage, float ms);
+		// heights of the tile under (x, z), if it's been built
+		const tileData *residentTile(float x, float z);
+
+		std::string tileName(tileCoord coord);
+		glm::vec3 tileOrigin(tileCoord coord);
+		generatorEvent tileEvent(generatorEvent::types type, tileCoord coord);
+		// runs on the main thread through addDeferred()
+		void attachTile(gameMain *game, tileCoord coord,
+		                unsigned serial, unsigned lod, generatedTile gen);
+		// main thread, called by the window as tiles come and go. a
+		// tile is linked into the scene and its collider added to the
+		// world when it's shown, and both are taken out when it's hidden
+		void crossedCell(tileCoord center);
+		void showTile(tileCoord coord, const builtTile& built, bool replacing);
+		void hideTile(tileCoord coord, const builtTile& built);
+
+		generatorConfig config;
+		// copied out of the config since they're used everywhere
+		uint32_t seed;
+		int gridsize;
+		float cellsize;
+
+		std::shared_ptr<tileStore> store;
+
+		std::mutex uploadMtx;
+		std::vector<pendingUpload> uploads;
+		std::atomic<uint64_t> stageMicros[stageCount] = {};
+		std::atomic<unsigned> stageRuns[stageCount] = {};
+
+		// everything below is only touched from the main thread, apart
+		// from the window's queue. the window is made once the config
+		// has been settled in the constructor
+		std::unique_ptr<modelWindow> window;
+		// game passed to the last setPosition() or update(), for the
+		// window's callbacks
+		gameMain *activeGame = nullptr;
+		std::list<std::future<bool>> jobs;
+		std::chrono::steady_clock::time_point crossedAt;
+		generatorStats stats;
 };
 
 // XXX: global variable, TODO: something else
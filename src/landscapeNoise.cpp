@@ -0,0 +1,880 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include "landscapeNoise.hpp"
+#include "landscapeNoiseInternal.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LANDSCAPE_NOISE_X86
+#include <immintrin.h>
+#endif
+
+// octave scales for landscapeThing(), largest first, last octave is
+// added at half weight
+static const unsigned octaves = 4;
+static const float octaveScales[octaves] = {75.f, 20.f, 5.f, 1.f};
+
+// number of samples processed per kernel call
+static const size_t blockSize = 256;
+
+// 16 evenly spaced unit vectors, written out rather than generated with
+// sin()/cos() so they don't depend on the libm in use
+static const glm::vec2 gradients[16] = {
+	{ 1.f,          0.f         }, { 0.92387953f,  0.38268343f },
+	{ 0.70710678f,  0.70710678f }, { 0.38268343f,  0.92387953f },
+	{ 0.f,          1.f         }, {-0.38268343f,  0.92387953f },
+	{-0.70710678f,  0.70710678f }, {-0.92387953f,  0.38268343f },
+	{-1.f,          0.f         }, {-0.92387953f, -0.38268343f },
+	{-0.70710678f, -0.70710678f }, {-0.38268343f, -0.92387953f },
+	{ 0.f,         -1.f         }, { 0.38268343f, -0.92387953f },
+	{ 0.70710678f, -0.70710678f }, { 0.92387953f, -0.38268343f },
+};
+
+// "lowbias32" integer finalizer, good avalanche for two multiplies
+static inline uint32_t hashMix(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+static inline uint32_t hashLattice(uint32_t seed, int32_t x, int32_t y) {
+	return hashMix(seed ^ hashMix(uint32_t(x) + hashMix(uint32_t(y))));
+}
+
+uint32_t latticeHash(uint32_t seed, glm::ivec2 i) {
+	return hashLattice(seed, i.x, i.y);
+}
+
+glm::vec2 randomGradient(uint32_t seed, glm::ivec2 i) {
+	// top bits of the hash are the best mixed
+	return gradients[hashLattice(seed, i.x, i.y) >> 28];
+}
+
+// NOTE: lerp() and the clamp in perlinNoise() are spelled out rather than
+//       using glm::mix()/max() so that the simd kernels below can do exactly
+//       the same operations in exactly the same order
+static inline float lerp(float a, float b, float t) {
+	return a*(1.f - t) + b*t;
+}
+
+float dotGradient(uint32_t seed, glm::vec2 i, glm::vec2 pos) {
+	glm::vec2 gradient = randomGradient(seed, glm::ivec2(i.x, i.y));
+	glm::vec2 dist = pos - i;
+
+	return glm::dot(dist, gradient);
+}
+
+float perlinNoise(uint32_t seed, float x, float y) {
+	glm::vec2 pos = { x, y };
+	glm::vec2 grid[2] = {
+		glm::floor(pos),
+		glm::floor(pos) + glm::vec2(1.0)
+	};
+	glm::vec2 weight = pos - grid[0];
+	float n[4];
+
+	for (unsigned i = 0; i < 4; i++) {
+		n[i] = dotGradient(seed, glm::vec2(grid[!!(i&1)].x, grid[!!(i&2)].y), pos);
+	}
+
+	float ix0 = lerp(n[0], n[1], weight.x);
+	float ix1 = lerp(n[2], n[3], weight.x);
+	float ret = lerp(ix0, ix1, weight.y);
+
+	return (ret > 0.f)? ret : 0.f;
+}
+
+// same as perlinNoise(), also returning the gradient with respect to x and y.
+// corners are blended linearly, so this is just the derivative of the two
+// lerps with the gradient dot products' own derivatives (the corner gradients)
+// mixed in. operations for the height are exactly the same as perlinNoise()
+float perlinNoiseGradient(uint32_t seed, float x, float y, glm::vec2& grad) {
+	glm::vec2 pos = { x, y };
+	glm::vec2 grid[2] = {
+		glm::floor(pos),
+		glm::floor(pos) + glm::vec2(1.0)
+	};
+	glm::vec2 weight = pos - grid[0];
+	glm::vec2 g[4];
+	float n[4];
+
+	for (unsigned i = 0; i < 4; i++) {
+		glm::vec2 corner = glm::vec2(grid[!!(i&1)].x, grid[!!(i&2)].y);
+		g[i] = randomGradient(seed, glm::ivec2(corner.x, corner.y));
+		n[i] = glm::dot(pos - corner, g[i]);
+	}
+
+	float ix0 = lerp(n[0], n[1], weight.x);
+	float ix1 = lerp(n[2], n[3], weight.x);
+	float ret = lerp(ix0, ix1, weight.y);
+
+	float iwx = 1.f - weight.x;
+	float iwy = 1.f - weight.y;
+	float dix0x = (iwx*g[0].x + weight.x*g[1].x) + (n[1] - n[0]);
+	float dix0y =  iwx*g[0].y + weight.x*g[1].y;
+	float dix1x = (iwx*g[2].x + weight.x*g[3].x) + (n[3] - n[2]);
+	float dix1y =  iwx*g[2].y + weight.x*g[3].y;
+
+	if (ret > 0.f) {
+		grad.x = iwy*dix0x + weight.y*dix1x;
+		grad.y = (iwy*dix0y + weight.y*dix1y) + (ix1 - ix0);
+	} else {
+		grad = glm::vec2(0.f);
+	}
+
+	return (ret > 0.f)? ret : 0.f;
+}
+
+float landscapeThing(uint32_t seed, float x, float y) {
+	auto scalednoise = [=](float scale, float x, float y) {
+		return scale*perlinNoise(seed, x / scale, y / scale);
+	};
+
+	// perlinNoise() is already clamped to >= 0, so the first octave doesn't
+	// need another max() here
+	float a1 = scalednoise(octaveScales[0], x, y);
+	float a2 = scalednoise(octaveScales[1], x, y);
+	float a3 = scalednoise(octaveScales[2], x, y);
+	float a4 = 0.5f*scalednoise(octaveScales[3], x, y);
+
+	return a1 + a2 + a3 + a4;
+}
+
+enum accumulate {
+	accSet,
+	accAdd,
+	accAddHalf,
+};
+
+static inline accumulate octaveAccumulate(unsigned octave) {
+	return (octave == 0)?           accSet
+	     : (octave == octaves - 1)? accAddHalf
+	     :                          accAdd;
+}
+
+float landscapeThingGradient(uint32_t seed, float x, float y, glm::vec2& grad) {
+	float ret = 0;
+
+	// d/dx of scale*noise(x/scale) is just noise'(x/scale), so octave
+	// gradients are added without scaling, same order as landscapeThing()
+	for (unsigned o = 0; o < octaves; o++) {
+		float scale = octaveScales[o];
+		glm::vec2 g;
+		float c = scale*perlinNoiseGradient(seed, x / scale, y / scale, g);
+
+		switch (octaveAccumulate(o)) {
+			case accSet:
+				ret = c;
+				grad = g;
+				break;
+			case accAdd:
+				ret = ret + c;
+				grad.x = grad.x + g.x;
+				grad.y = grad.y + g.y;
+				break;
+			case accAddHalf:
+				ret = ret + 0.5f*c;
+				grad.x = grad.x + 0.5f*g.x;
+				grad.y = grad.y + 0.5f*g.y;
+				break;
+		}
+	}
+
+	return ret;
+}
+
+// inputs for one octave over a block of samples, gradients are indexed
+// in the same corner order as perlinNoise()
+struct octaveLanes {
+	float px[blockSize], py[blockSize];
+	float fx[blockSize], fy[blockSize];
+	float gx[4][blockSize], gy[4][blockSize];
+};
+
+typedef void (*octaveKernel)(const octaveLanes& lanes, size_t start, size_t end,
+                             float scale, accumulate acc, float *out);
+// same, also accumulating the gradient into dx and dy
+typedef void (*gradientKernel)(const octaveLanes& lanes, size_t start, size_t end,
+                               float scale, accumulate acc,
+                               float *out, float *dx, float *dy);
+
+static void octaveKernelScalar(const octaveLanes& l, size_t start, size_t end,
+                               float scale, accumulate acc, float *out)
+{
+	for (size_t i = start; i < end; i++) {
+		float wx  = l.px[i] - l.fx[i];
+		float wy  = l.py[i] - l.fy[i];
+		float dx1 = l.px[i] - (l.fx[i] + 1.f);
+		float dy1 = l.py[i] - (l.fy[i] + 1.f);
+
+		float n0 = wx*l.gx[0][i]  + wy*l.gy[0][i];
+		float n1 = dx1*l.gx[1][i] + wy*l.gy[1][i];
+		float n2 = wx*l.gx[2][i]  + dy1*l.gy[2][i];
+		float n3 = dx1*l.gx[3][i] + dy1*l.gy[3][i];
+
+		float ix0 = lerp(n0, n1, wx);
+		float ix1 = lerp(n2, n3, wx);
+		float r   = lerp(ix0, ix1, wy);
+		float c   = scale*((r > 0.f)? r : 0.f);
+
+		switch (acc) {
+			case accSet:     out[i] = c; break;
+			case accAdd:     out[i] = out[i] + c; break;
+			case accAddHalf: out[i] = out[i] + 0.5f*c; break;
+		}
+	}
+}
+
+#if defined(LANDSCAPE_NOISE_X86)
+__attribute__((target("sse2")))
+static void octaveKernelSSE2(const octaveLanes& l, size_t start, size_t end,
+                             float scale, accumulate acc, float *out)
+{
+	const __m128 one    = _mm_set1_ps(1.f);
+	const __m128 zero   = _mm_setzero_ps();
+	const __m128 half   = _mm_set1_ps(0.5f);
+	const __m128 vscale = _mm_set1_ps(scale);
+	size_t i = start;
+
+	for (; i + 4 <= end; i += 4) {
+		__m128 px = _mm_loadu_ps(l.px + i);
+		__m128 py = _mm_loadu_ps(l.py + i);
+		__m128 fx = _mm_loadu_ps(l.fx + i);
+		__m128 fy = _mm_loadu_ps(l.fy + i);
+
+		__m128 wx  = _mm_sub_ps(px, fx);
+		__m128 wy  = _mm_sub_ps(py, fy);
+		__m128 dx1 = _mm_sub_ps(px, _mm_add_ps(fx, one));
+		__m128 dy1 = _mm_sub_ps(py, _mm_add_ps(fy, one));
+
+		__m128 n0 = _mm_add_ps(_mm_mul_ps(wx,  _mm_loadu_ps(l.gx[0] + i)),
+		                       _mm_mul_ps(wy,  _mm_loadu_ps(l.gy[0] + i)));
+		__m128 n1 = _mm_add_ps(_mm_mul_ps(dx1, _mm_loadu_ps(l.gx[1] + i)),
+		                       _mm_mul_ps(wy,  _mm_loadu_ps(l.gy[1] + i)));
+		__m128 n2 = _mm_add_ps(_mm_mul_ps(wx,  _mm_loadu_ps(l.gx[2] + i)),
+		                       _mm_mul_ps(dy1, _mm_loadu_ps(l.gy[2] + i)));
+		__m128 n3 = _mm_add_ps(_mm_mul_ps(dx1, _mm_loadu_ps(l.gx[3] + i)),
+		                       _mm_mul_ps(dy1, _mm_loadu_ps(l.gy[3] + i)));
+
+		__m128 iwx = _mm_sub_ps(one, wx);
+		__m128 iwy = _mm_sub_ps(one, wy);
+		__m128 ix0 = _mm_add_ps(_mm_mul_ps(n0, iwx), _mm_mul_ps(n1, wx));
+		__m128 ix1 = _mm_add_ps(_mm_mul_ps(n2, iwx), _mm_mul_ps(n3, wx));
+		__m128 r   = _mm_add_ps(_mm_mul_ps(ix0, iwy), _mm_mul_ps(ix1, wy));
+		// max(r, 0) returns the second operand for NaN/-0, same as the
+		// (r > 0)? r : 0 in the scalar version
+		__m128 c   = _mm_mul_ps(vscale, _mm_max_ps(r, zero));
+
+		switch (acc) {
+			case accSet:
+				_mm_storeu_ps(out + i, c);
+				break;
+			case accAdd:
+				_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), c));
+				break;
+			case accAddHalf:
+				_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i),
+				                                  _mm_mul_ps(half, c)));
+				break;
+		}
+	}
+
+	octaveKernelScalar(l, i, end, scale, acc, out);
+}
+
+__attribute__((target("avx2")))
+static void octaveKernelAVX2(const octaveLanes& l, size_t start, size_t end,
+                             float scale, accumulate acc, float *out)
+{
+	const __m256 one    = _mm256_set1_ps(1.f);
+	const __m256 zero   = _mm256_setzero_ps();
+	const __m256 half   = _mm256_set1_ps(0.5f);
+	const __m256 vscale = _mm256_set1_ps(scale);
+	size_t i = start;
+
+	for (; i + 8 <= end; i += 8) {
+		__m256 px = _mm256_loadu_ps(l.px + i);
+		__m256 py = _mm256_loadu_ps(l.py + i);
+		__m256 fx = _mm256_loadu_ps(l.fx + i);
+		__m256 fy = _mm256_loadu_ps(l.fy + i);
+
+		__m256 wx  = _mm256_sub_ps(px, fx);
+		__m256 wy  = _mm256_sub_ps(py, fy);
+		__m256 dx1 = _mm256_sub_ps(px, _mm256_add_ps(fx, one));
+		__m256 dy1 = _mm256_sub_ps(py, _mm256_add_ps(fy, one));
+
+		__m256 n0 = _mm256_add_ps(_mm256_mul_ps(wx,  _mm256_loadu_ps(l.gx[0] + i)),
+		                          _mm256_mul_ps(wy,  _mm256_loadu_ps(l.gy[0] + i)));
+		__m256 n1 = _mm256_add_ps(_mm256_mul_ps(dx1, _mm256_loadu_ps(l.gx[1] + i)),
+		                          _mm256_mul_ps(wy,  _mm256_loadu_ps(l.gy[1] + i)));
+		__m256 n2 = _mm256_add_ps(_mm256_mul_ps(wx,  _mm256_loadu_ps(l.gx[2] + i)),
+		                          _mm256_mul_ps(dy1, _mm256_loadu_ps(l.gy[2] + i)));
+		__m256 n3 = _mm256_add_ps(_mm256_mul_ps(dx1, _mm256_loadu_ps(l.gx[3] + i)),
+		                          _mm256_mul_ps(dy1, _mm256_loadu_ps(l.gy[3] + i)));
+
+		__m256 iwx = _mm256_sub_ps(one, wx);
+		__m256 iwy = _mm256_sub_ps(one, wy);
+		__m256 ix0 = _mm256_add_ps(_mm256_mul_ps(n0, iwx), _mm256_mul_ps(n1, wx));
+		__m256 ix1 = _mm256_add_ps(_mm256_mul_ps(n2, iwx), _mm256_mul_ps(n3, wx));
+		__m256 r   = _mm256_add_ps(_mm256_mul_ps(ix0, iwy), _mm256_mul_ps(ix1, wy));
+		__m256 c   = _mm256_mul_ps(vscale, _mm256_max_ps(r, zero));
+
+		switch (acc) {
+			case accSet:
+				_mm256_storeu_ps(out + i, c);
+				break;
+			case accAdd:
+				_mm256_storeu_ps(out + i,
+					_mm256_add_ps(_mm256_loadu_ps(out + i), c));
+				break;
+			case accAddHalf:
+				_mm256_storeu_ps(out + i,
+					_mm256_add_ps(_mm256_loadu_ps(out + i),
+					              _mm256_mul_ps(half, c)));
+				break;
+		}
+	}
+
+	octaveKernelSSE2(l, i, end, scale, acc, out);
+}
+
+#if !defined(LANDSCAPE_REPRODUCIBLE)
+// same as the AVX2 kernel with fused multiply-adds, rounds differently from
+// the scalar version so only used when reproducibility isn't required
+__attribute__((target("avx2,fma")))
+static void octaveKernelFMA(const octaveLanes& l, size_t start, size_t end,
+                            float scale, accumulate acc, float *out)
+{
+	const __m256 one    = _mm256_set1_ps(1.f);
+	const __m256 zero   = _mm256_setzero_ps();
+	const __m256 half   = _mm256_set1_ps(0.5f);
+	const __m256 vscale = _mm256_set1_ps(scale);
+	size_t i = start;
+
+	for (; i + 8 <= end; i += 8) {
+		__m256 px = _mm256_loadu_ps(l.px + i);
+		__m256 py = _mm256_loadu_ps(l.py + i);
+		__m256 fx = _mm256_loadu_ps(l.fx + i);
+		__m256 fy = _mm256_loadu_ps(l.fy + i);
+
+		__m256 wx  = _mm256_sub_ps(px, fx);
+		__m256 wy  = _mm256_sub_ps(py, fy);
+		__m256 dx1 = _mm256_sub_ps(wx, one);
+		__m256 dy1 = _mm256_sub_ps(wy, one);
+
+		__m256 n0 = _mm256_fmadd_ps(wx,  _mm256_loadu_ps(l.gx[0] + i),
+		                            _mm256_mul_ps(wy,  _mm256_loadu_ps(l.gy[0] + i)));
+		__m256 n1 = _mm256_fmadd_ps(dx1, _mm256_loadu_ps(l.gx[1] + i),
+		                            _mm256_mul_ps(wy,  _mm256_loadu_ps(l.gy[1] + i)));
+		__m256 n2 = _mm256_fmadd_ps(wx,  _mm256_loadu_ps(l.gx[2] + i),
+		                            _mm256_mul_ps(dy1, _mm256_loadu_ps(l.gy[2] + i)));
+		__m256 n3 = _mm256_fmadd_ps(dx1, _mm256_loadu_ps(l.gx[3] + i),
+		                            _mm256_mul_ps(dy1, _mm256_loadu_ps(l.gy[3] + i)));
+
+		// a + t*(b - a) form of lerp, one fma each
+		__m256 ix0 = _mm256_fmadd_ps(wx, _mm256_sub_ps(n1, n0), n0);
+		__m256 ix1 = _mm256_fmadd_ps(wx, _mm256_sub_ps(n3, n2), n2);
+		__m256 r   = _mm256_fmadd_ps(wy, _mm256_sub_ps(ix1, ix0), ix0);
+		__m256 c   = _mm256_mul_ps(vscale, _mm256_max_ps(r, zero));
+
+		switch (acc) {
+			case accSet:
+				_mm256_storeu_ps(out + i, c);
+				break;
+			case accAdd:
+				_mm256_storeu_ps(out + i,
+					_mm256_add_ps(_mm256_loadu_ps(out + i), c));
+				break;
+			case accAddHalf:
+				_mm256_storeu_ps(out + i,
+					_mm256_fmadd_ps(half, c, _mm256_loadu_ps(out + i)));
+				break;
+		}
+	}
+
+	octaveKernelSSE2(l, i, end, scale, acc, out);
+}
+#endif
+#endif
+
+static void gradientKernelScalar(const octaveLanes& l, size_t start, size_t end,
+                                 float scale, accumulate acc,
+                                 float *out, float *dx, float *dy)
+{
+	for (size_t i = start; i < end; i++) {
+		float wx  = l.px[i] - l.fx[i];
+		float wy  = l.py[i] - l.fy[i];
+		float dx1 = l.px[i] - (l.fx[i] + 1.f);
+		float dy1 = l.py[i] - (l.fy[i] + 1.f);
+
+		float n0 = wx*l.gx[0][i]  + wy*l.gy[0][i];
+		float n1 = dx1*l.gx[1][i] + wy*l.gy[1][i];
+		float n2 = wx*l.gx[2][i]  + dy1*l.gy[2][i];
+		float n3 = dx1*l.gx[3][i] + dy1*l.gy[3][i];
+
+		float ix0 = lerp(n0, n1, wx);
+		float ix1 = lerp(n2, n3, wx);
+		float r   = lerp(ix0, ix1, wy);
+		float c   = scale*((r > 0.f)? r : 0.f);
+
+		float iwx = 1.f - wx;
+		float iwy = 1.f - wy;
+		float dix0x = (iwx*l.gx[0][i] + wx*l.gx[1][i]) + (n1 - n0);
+		float dix0y =  iwx*l.gy[0][i] + wx*l.gy[1][i];
+		float dix1x = (iwx*l.gx[2][i] + wx*l.gx[3][i]) + (n3 - n2);
+		float dix1y =  iwx*l.gy[2][i] + wx*l.gy[3][i];
+		float gx = (r > 0.f)? iwy*dix0x + wy*dix1x : 0.f;
+		float gy = (r > 0.f)? (iwy*dix0y + wy*dix1y) + (ix1 - ix0) : 0.f;
+
+		switch (acc) {
+			case accSet:
+				out[i] = c;
+				dx[i] = gx;
+				dy[i] = gy;
+				break;
+			case accAdd:
+				out[i] = out[i] + c;
+				dx[i] = dx[i] + gx;
+				dy[i] = dy[i] + gy;
+				break;
+			case accAddHalf:
+				out[i] = out[i] + 0.5f*c;
+				dx[i] = dx[i] + 0.5f*gx;
+				dy[i] = dy[i] + 0.5f*gy;
+				break;
+		}
+	}
+}
+
+#if defined(LANDSCAPE_NOISE_X86)
+__attribute__((target("sse2")))
+static void gradientKernelSSE2(const octaveLanes& l, size_t start, size_t end,
+                               float scale, accumulate acc,
+                               float *out, float *dx, float *dy)
+{
+	const __m128 one    = _mm_set1_ps(1.f);
+	const __m128 zero   = _mm_setzero_ps();
+	const __m128 half   = _mm_set1_ps(0.5f);
+	const __m128 vscale = _mm_set1_ps(scale);
+	size_t i = start;
+
+	for (; i + 4 <= end; i += 4) {
+		__m128 px = _mm_loadu_ps(l.px + i);
+		__m128 py = _mm_loadu_ps(l.py + i);
+		__m128 fx = _mm_loadu_ps(l.fx + i);
+		__m128 fy = _mm_loadu_ps(l.fy + i);
+		__m128 g0x = _mm_loadu_ps(l.gx[0] + i), g0y = _mm_loadu_ps(l.gy[0] + i);
+		__m128 g1x = _mm_loadu_ps(l.gx[1] + i), g1y = _mm_loadu_ps(l.gy[1] + i);
+		__m128 g2x = _mm_loadu_ps(l.gx[2] + i), g2y = _mm_loadu_ps(l.gy[2] + i);
+		__m128 g3x = _mm_loadu_ps(l.gx[3] + i), g3y = _mm_loadu_ps(l.gy[3] + i);
+
+		__m128 wx  = _mm_sub_ps(px, fx);
+		__m128 wy  = _mm_sub_ps(py, fy);
+		__m128 dx1 = _mm_sub_ps(px, _mm_add_ps(fx, one));
+		__m128 dy1 = _mm_sub_ps(py, _mm_add_ps(fy, one));
+
+		__m128 n0 = _mm_add_ps(_mm_mul_ps(wx,  g0x), _mm_mul_ps(wy,  g0y));
+		__m128 n1 = _mm_add_ps(_mm_mul_ps(dx1, g1x), _mm_mul_ps(wy,  g1y));
+		__m128 n2 = _mm_add_ps(_mm_mul_ps(wx,  g2x), _mm_mul_ps(dy1, g2y));
+		__m128 n3 = _mm_add_ps(_mm_mul_ps(dx1, g3x), _mm_mul_ps(dy1, g3y));
+
+		__m128 iwx = _mm_sub_ps(one, wx);
+		__m128 iwy = _mm_sub_ps(one, wy);
+		__m128 ix0 = _mm_add_ps(_mm_mul_ps(n0, iwx), _mm_mul_ps(n1, wx));
+		__m128 ix1 = _mm_add_ps(_mm_mul_ps(n2, iwx), _mm_mul_ps(n3, wx));
+		__m128 r   = _mm_add_ps(_mm_mul_ps(ix0, iwy), _mm_mul_ps(ix1, wy));
+		__m128 c   = _mm_mul_ps(vscale, _mm_max_ps(r, zero));
+
+		__m128 dix0x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(iwx, g0x), _mm_mul_ps(wx, g1x)),
+		                          _mm_sub_ps(n1, n0));
+		__m128 dix0y = _mm_add_ps(_mm_mul_ps(iwx, g0y), _mm_mul_ps(wx, g1y));
+		__m128 dix1x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(iwx, g2x), _mm_mul_ps(wx, g3x)),
+		                          _mm_sub_ps(n3, n2));
+		__m128 dix1y = _mm_add_ps(_mm_mul_ps(iwx, g2y), _mm_mul_ps(wx, g3y));
+
+		// gradient is zero wherever the octave was clamped, NaN compares
+		// false same as in the scalar version
+		__m128 live = _mm_cmpgt_ps(r, zero);
+		__m128 gx = _mm_and_ps(live, _mm_add_ps(_mm_mul_ps(iwy, dix0x),
+		                                        _mm_mul_ps(wy, dix1x)));
+		__m128 gy = _mm_and_ps(live, _mm_add_ps(_mm_add_ps(_mm_mul_ps(iwy, dix0y),
+		                                                   _mm_mul_ps(wy, dix1y)),
+		                                        _mm_sub_ps(ix1, ix0)));
+
+		switch (acc) {
+			case accSet:
+				_mm_storeu_ps(out + i, c);
+				_mm_storeu_ps(dx + i, gx);
+				_mm_storeu_ps(dy + i, gy);
+				break;
+			case accAdd:
+				_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), c));
+				_mm_storeu_ps(dx + i, _mm_add_ps(_mm_loadu_ps(dx + i), gx));
+				_mm_storeu_ps(dy + i, _mm_add_ps(_mm_loadu_ps(dy + i), gy));
+				break;
+			case accAddHalf:
+				_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i),
+				                                  _mm_mul_ps(half, c)));
+				_mm_storeu_ps(dx + i, _mm_add_ps(_mm_loadu_ps(dx + i),
+				                                 _mm_mul_ps(half, gx)));
+				_mm_storeu_ps(dy + i, _mm_add_ps(_mm_loadu_ps(dy + i),
+				                                 _mm_mul_ps(half, gy)));
+				break;
+		}
+	}
+
+	gradientKernelScalar(l, i, end, scale, acc, out, dx, dy);
+}
+
+__attribute__((target("avx2")))
+static void gradientKernelAVX2(const octaveLanes& l, size_t start, size_t end,
+                               float scale, accumulate acc,
+                               float *out, float *dx, float *dy)
+{
+	const __m256 one    = _mm256_set1_ps(1.f);
+	const __m256 zero   = _mm256_setzero_ps();
+	const __m256 half   = _mm256_set1_ps(0.5f);
+	const __m256 vscale = _mm256_set1_ps(scale);
+	size_t i = start;
+
+	for (; i + 8 <= end; i += 8) {
+		__m256 px = _mm256_loadu_ps(l.px + i);
+		__m256 py = _mm256_loadu_ps(l.py + i);
+		__m256 fx = _mm256_loadu_ps(l.fx + i);
+		__m256 fy = _mm256_loadu_ps(l.fy + i);
+		__m256 g0x = _mm256_loadu_ps(l.gx[0] + i), g0y = _mm256_loadu_ps(l.gy[0] + i);
+		__m256 g1x = _mm256_loadu_ps(l.gx[1] + i), g1y = _mm256_loadu_ps(l.gy[1] + i);
+		__m256 g2x = _mm256_loadu_ps(l.gx[2] + i), g2y = _mm256_loadu_ps(l.gy[2] + i);
+		__m256 g3x = _mm256_loadu_ps(l.gx[3] + i), g3y = _mm256_loadu_ps(l.gy[3] + i);
+
+		__m256 wx  = _mm256_sub_ps(px, fx);
+		__m256 wy  = _mm256_sub_ps(py, fy);
+		__m256 dx1 = _mm256_sub_ps(px, _mm256_add_ps(fx, one));
+		__m256 dy1 = _mm256_sub_ps(py, _mm256_add_ps(fy, one));
+
+		__m256 n0 = _mm256_add_ps(_mm256_mul_ps(wx,  g0x), _mm256_mul_ps(wy,  g0y));
+		__m256 n1 = _mm256_add_ps(_mm256_mul_ps(dx1, g1x), _mm256_mul_ps(wy,  g1y));
+		__m256 n2 = _mm256_add_ps(_mm256_mul_ps(wx,  g2x), _mm256_mul_ps(dy1, g2y));
+		__m256 n3 = _mm256_add_ps(_mm256_mul_ps(dx1, g3x), _mm256_mul_ps(dy1, g3y));
+
+		__m256 iwx = _mm256_sub_ps(one, wx);
+		__m256 iwy = _mm256_sub_ps(one, wy);
+		__m256 ix0 = _mm256_add_ps(_mm256_mul_ps(n0, iwx), _mm256_mul_ps(n1, wx));
+		__m256 ix1 = _mm256_add_ps(_mm256_mul_ps(n2, iwx), _mm256_mul_ps(n3, wx));
+		__m256 r   = _mm256_add_ps(_mm256_mul_ps(ix0, iwy), _mm256_mul_ps(ix1, wy));
+		__m256 c   = _mm256_mul_ps(vscale, _mm256_max_ps(r, zero));
+
+		__m256 dix0x = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(iwx, g0x),
+		                                           _mm256_mul_ps(wx, g1x)),
+		                             _mm256_sub_ps(n1, n0));
+		__m256 dix0y = _mm256_add_ps(_mm256_mul_ps(iwx, g0y), _mm256_mul_ps(wx, g1y));
+		__m256 dix1x = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(iwx, g2x),
+		                                           _mm256_mul_ps(wx, g3x)),
+		                             _mm256_sub_ps(n3, n2));
+		__m256 dix1y = _mm256_add_ps(_mm256_mul_ps(iwx, g2y), _mm256_mul_ps(wx, g3y));
+
+		__m256 live = _mm256_cmp_ps(r, zero, _CMP_GT_OQ);
+		__m256 gx = _mm256_and_ps(live, _mm256_add_ps(_mm256_mul_ps(iwy, dix0x),
+		                                              _mm256_mul_ps(wy, dix1x)));
+		__m256 gy = _mm256_and_ps(live,
+			_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(iwy, dix0y),
+			                            _mm256_mul_ps(wy, dix1y)),
+			              _mm256_sub_ps(ix1, ix0)));
+
+		switch (acc) {
+			case accSet:
+				_mm256_storeu_ps(out + i, c);
+				_mm256_storeu_ps(dx + i, gx);
+				_mm256_storeu_ps(dy + i, gy);
+				break;
+			case accAdd:
+				_mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), c));
+				_mm256_storeu_ps(dx + i, _mm256_add_ps(_mm256_loadu_ps(dx + i), gx));
+				_mm256_storeu_ps(dy + i, _mm256_add_ps(_mm256_loadu_ps(dy + i), gy));
+				break;
+			case accAddHalf:
+				_mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i),
+				                                        _mm256_mul_ps(half, c)));
+				_mm256_storeu_ps(dx + i, _mm256_add_ps(_mm256_loadu_ps(dx + i),
+				                                       _mm256_mul_ps(half, gx)));
+				_mm256_storeu_ps(dy + i, _mm256_add_ps(_mm256_loadu_ps(dy + i),
+				                                       _mm256_mul_ps(half, gy)));
+				break;
+		}
+	}
+
+	gradientKernelSSE2(l, i, end, scale, acc, out, dx, dy);
+}
+#endif
+
+static octaveKernel selectKernel(void) {
+#if defined(LANDSCAPE_NOISE_X86)
+	__builtin_cpu_init();
+
+#if !defined(LANDSCAPE_REPRODUCIBLE)
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		return octaveKernelFMA;
+	}
+#endif
+
+	if (__builtin_cpu_supports("avx2")) {
+		return octaveKernelAVX2;
+	}
+
+	if (__builtin_cpu_supports("sse2")) {
+		return octaveKernelSSE2;
+	}
+#endif
+
+	return octaveKernelScalar;
+}
+
+// set by setNoiseKernel(), null to use whatever's best
+static octaveKernel forcedKernel = nullptr;
+static gradientKernel forcedGradientKernel = nullptr;
+
+static octaveKernel getKernel(void) {
+	static const octaveKernel kernel = selectKernel();
+	return forcedKernel? forcedKernel : kernel;
+}
+
+// there's no FMA version of the gradient kernels, they're only used for
+// building tiles and the heights need to match landscapeThing() anyway
+static gradientKernel selectGradientKernel(void) {
+#if defined(LANDSCAPE_NOISE_X86)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2")) {
+		return gradientKernelAVX2;
+	}
+
+	if (__builtin_cpu_supports("sse2")) {
+		return gradientKernelSSE2;
+	}
+#endif
+
+	return gradientKernelScalar;
+}
+
+static gradientKernel getGradientKernel(void) {
+	static const gradientKernel kernel = selectGradientKernel();
+	return forcedGradientKernel? forcedGradientKernel : kernel;
+}
+
+bool setNoiseKernel(noiseKernel kernel) {
+	octaveKernel k = nullptr;
+	gradientKernel g = nullptr;
+
+#if defined(LANDSCAPE_NOISE_X86)
+	__builtin_cpu_init();
+#endif
+
+	switch (kernel) {
+		case noiseKernel::automatic:
+			break;
+
+		case noiseKernel::scalar:
+			k = octaveKernelScalar;
+			g = gradientKernelScalar;
+			break;
+
+#if defined(LANDSCAPE_NOISE_X86)
+		case noiseKernel::sse2:
+			if (!__builtin_cpu_supports("sse2")) return false;
+			k = octaveKernelSSE2;
+			g = gradientKernelSSE2;
+			break;
+
+		case noiseKernel::avx2:
+			if (!__builtin_cpu_supports("avx2")) return false;
+			k = octaveKernelAVX2;
+			g = gradientKernelAVX2;
+			break;
+
+#if !defined(LANDSCAPE_REPRODUCIBLE)
+		case noiseKernel::fma:
+			if (!__builtin_cpu_supports("avx2")
+			    || !__builtin_cpu_supports("fma")) return false;
+			k = octaveKernelFMA;
+			g = gradientKernelAVX2;
+			break;
+#endif
+#endif
+
+		default:
+			return false;
+	}
+
+	forcedKernel = k;
+	forcedGradientKernel = g;
+	return true;
+}
+
+static void fillGradientRow(uint32_t seed, std::vector<glm::vec2>& row,
+                            int32_t x, int32_t y)
+{
+	for (size_t i = 0; i < row.size(); i++) {
+		row[i] = randomGradient(seed, glm::ivec2(x + int32_t(i), y));
+	}
+}
+
+// gradients are only worked out if dx and dy aren't null
+// rows [first, first + depth) of the grid, written from the start of out
+static void sampleGrid(uint32_t seed, float x, float y, float unit,
+                       size_t width, size_t first, size_t depth,
+                       float *out, float *dx, float *dy)
+{
+	if (width == 0 || depth == 0) {
+		return;
+	}
+
+	octaveKernel kernel = getKernel();
+	gradientKernel gkernel = getGradientKernel();
+	octaveLanes lanes;
+
+	std::vector<float> colpx(width);
+	std::vector<float> colfx(width);
+	std::vector<size_t> colidx(width);
+	std::vector<glm::vec2> rows[2];
+
+	for (unsigned o = 0; o < octaves; o++) {
+		float scale = octaveScales[o];
+		accumulate acc = octaveAccumulate(o);
+
+		// lattice columns are the same for every row, only need to
+		// work those out once per octave
+		for (size_t i = 0; i < width; i++) {
+			colpx[i] = (x + float(i)*unit) / scale;
+			colfx[i] = floorf(colpx[i]);
+		}
+
+		float latx = colfx[0];
+		size_t latwidth = size_t(colfx[width - 1] - latx) + 2;
+
+		for (size_t i = 0; i < width; i++) {
+			colidx[i] = size_t(colfx[i] - latx);
+		}
+
+		rows[0].resize(latwidth);
+		rows[1].resize(latwidth);
+		bool haveRows = false;
+		float laty = 0;
+
+		for (size_t k = 0; k < depth; k++) {
+			float py = (y + float(first + k)*unit) / scale;
+			float fy = floorf(py);
+
+			// gradients only change when the sample row crosses into
+			// a new lattice row
+			if (!haveRows || fy != laty) {
+				if (haveRows && fy == laty + 1.f) {
+					std::swap(rows[0], rows[1]);
+					fillGradientRow(seed, rows[1], int32_t(latx), int32_t(fy) + 1);
+
+				} else {
+					fillGradientRow(seed, rows[0], int32_t(latx), int32_t(fy));
+					fillGradientRow(seed, rows[1], int32_t(latx), int32_t(fy) + 1);
+				}
+
+				haveRows = true;
+				laty = fy;
+			}
+
+			for (size_t base = 0; base < width; base += blockSize) {
+				size_t n = std::min(blockSize, width - base);
+
+				for (size_t j = 0; j < n; j++) {
+					size_t c = colidx[base + j];
+
+					lanes.px[j] = colpx[base + j];
+					lanes.fx[j] = colfx[base + j];
+					lanes.py[j] = py;
+					lanes.fy[j] = fy;
+
+					lanes.gx[0][j] = rows[0][c].x;     lanes.gy[0][j] = rows[0][c].y;
+					lanes.gx[1][j] = rows[0][c + 1].x; lanes.gy[1][j] = rows[0][c + 1].y;
+					lanes.gx[2][j] = rows[1][c].x;     lanes.gy[2][j] = rows[1][c].y;
+					lanes.gx[3][j] = rows[1][c + 1].x; lanes.gy[3][j] = rows[1][c + 1].y;
+				}
+
+				size_t off = k*width + base;
+
+				if (dx && dy) {
+					gkernel(lanes, 0, n, scale, acc, out + off, dx + off, dy + off);
+				} else {
+					kernel(lanes, 0, n, scale, acc, out + off);
+				}
+			}
+		}
+	}
+}
+
+void landscapeThingGrid(uint32_t seed, float x, float y, float unit,
+                        size_t width, size_t depth, float *out)
+{
+	sampleGrid(seed, x, y, unit, width, 0, depth, out, nullptr, nullptr);
+}
+
+void landscapeThingGridGradient(uint32_t seed, float x, float y, float unit,
+                                size_t width, size_t depth,
+                                float *out, float *dx, float *dy)
+{
+	sampleGrid(seed, x, y, unit, width, 0, depth, out, dx, dy);
+}
+
+void landscapeThingGridGradientRows(uint32_t seed, float x, float y, float unit,
+                                    size_t width, size_t first, size_t count,
+                                    float *out, float *dx, float *dy)
+{
+	sampleGrid(seed, x, y, unit, width, first, count, out, dx, dy);
+}
+
+void landscapeThingRow(uint32_t seed, float x, float y, float unit,
+                       size_t count, float *out)
+{
+	landscapeThingGrid(seed, x, y, unit, count, 1, out);
+}
+
+void landscapeThingPoints(uint32_t seed, const glm::vec2 *points,
+                          size_t count, float *out)
+{
+	octaveKernel kernel = getKernel();
+	octaveLanes lanes;
+
+	for (size_t base = 0; base < count; base += blockSize) {
+		size_t n = std::min(blockSize, count - base);
+
+		for (unsigned o = 0; o < octaves; o++) {
+			float scale = octaveScales[o];
+
+			// arbitrary points don't share lattice corners in any useful
+			// way, so gradients are still evaluated per sample here
+			for (size_t j = 0; j < n; j++) {
+				float px = points[base + j].x / scale;
+				float py = points[base + j].y / scale;
+				float fx = floorf(px);
+				float fy = floorf(py);
+
+				lanes.px[j] = px;
+				lanes.py[j] = py;
+				lanes.fx[j] = fx;
+				lanes.fy[j] = fy;
+
+				for (unsigned c = 0; c < 4; c++) {
+					glm::vec2 g = randomGradient(seed, glm::ivec2(
+						int32_t(fx) + ((c & 1)? 1 : 0),
+						int32_t(fy) + ((c & 2)? 1 : 0)));
+
+					lanes.gx[c][j] = g.x;
+					lanes.gy[c][j] = g.y;
+				}
+			}
+
+			kernel(lanes, 0, n, scale, octaveAccumulate(o), out + base);
+		}
+	}
+}
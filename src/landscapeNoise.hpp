@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <stddef.h>
+#include <stdint.h>
+
+// gradient noise used for the landscape, gradients come from an integer hash
+// of the lattice coordinate and seed, so the same seed gives the same terrain
+// everywhere.
+//
+// with LANDSCAPE_REPRODUCIBLE defined (the default, see CMakeLists.txt)
+// heights are bit-identical across x86-64 builds and between the scalar
+// and batched versions. without it the batched versions may use FMA kernels,
+// which are faster but round differently.
+glm::vec2 randomGradient(uint32_t seed, glm::ivec2 i);
+// the hash randomGradient() uses, for anything else that needs to be
+// random per lattice cell
+uint32_t latticeHash(uint32_t seed, glm::ivec2 i);
+float landscapeThing(uint32_t seed, float x, float y);
+// height and its analytic gradient (d/dx, d/dy) in one evaluation, the
+// height is exactly what landscapeThing() returns
+float landscapeThingGradient(uint32_t seed, float x, float y, glm::vec2& grad);
+
+// batched versions of landscapeThing(), a lot cheaper per sample.
+//
+// the grid/row versions share lattice gradients between neighbouring
+// samples, which is where most of the time goes in the scalar version.
+// samples are at (x + i*unit, y + k*unit), written row-major (k*width + i)
+void landscapeThingGrid(uint32_t seed, float x, float y, float unit,
+                        size_t width, size_t depth, float *out);
+// same with gradients, written to dx and dy in the same layout as out
+void landscapeThingGridGradient(uint32_t seed, float x, float y, float unit,
+                                size_t width, size_t depth,
+                                float *out, float *dx, float *dy);
+// rows [first, first + count) of the same grid, exactly what the full call
+// writes for those rows, so a grid can be split up between threads
+void landscapeThingGridGradientRows(uint32_t seed, float x, float y, float unit,
+                                    size_t width, size_t first, size_t count,
+                                    float *out, float *dx, float *dy);
+void landscapeThingRow(uint32_t seed, float x, float y, float unit,
+                       size_t count, float *out);
+void landscapeThingPoints(uint32_t seed, const glm::vec2 *points,
+                          size_t count, float *out);
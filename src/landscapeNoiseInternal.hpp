@@ -0,0 +1,29 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <stdint.h>
+
+// building blocks of landscapeNoise.cpp, only meant for the noise benchmark
+// and golden value checks (see noiseBench.cpp), everything else should go
+// through landscapeNoise.hpp
+
+// gradient at lattice point i dotted with the offset from i to pos
+float dotGradient(uint32_t seed, glm::vec2 i, glm::vec2 pos);
+// one octave of noise at unit scale, clamped to zero
+float perlinNoise(uint32_t seed, float x, float y);
+float perlinNoiseGradient(uint32_t seed, float x, float y, glm::vec2& grad);
+
+enum class noiseKernel {
+	// best one the CPU supports
+	automatic,
+	scalar,
+	sse2,
+	avx2,
+	// only built without LANDSCAPE_REPRODUCIBLE
+	fma,
+};
+
+// forces the batched functions to use a particular kernel, returns false
+// (and changes nothing) if it isn't available in this build or on this CPU.
+// not thread safe, only call this while nothing is sampling
+bool setNoiseKernel(noiseKernel kernel);
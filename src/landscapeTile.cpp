@@ -0,0 +1,423 @@
+#include <math.h>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "landscapeTile.hpp"
+#include "landscapeNoise.hpp"
+
+float tileData::operator()(float px, float pz) const {
+	long i = lroundf((px - x) / unit);
+	long k = lroundf((pz - z) / unit);
+
+	// only return cached samples for exactly the same coordinates,
+	// anything else falls back to the scalar version
+	if (i >= 0 && i < long(samples) && k >= 0 && k < long(samples)
+	    && x + float(i)*unit == px && z + float(k)*unit == pz)
+	{
+		return height(k*samples + i);
+	}
+
+	return landscapeThing(seed, px, pz);
+}
+
+int16_t tileData::packHeight(float h) {
+	return std::clamp(lroundf(h / heightStep), -32767L, 32767L);
+}
+
+uint16_t tileData::packNormal(glm::vec3 n) {
+	// project onto the octahedron, y up
+	n = n / (fabsf(n.x) + fabsf(n.y) + fabsf(n.z));
+	float u = n.x;
+	float v = n.z;
+
+	if (n.y < 0) {
+		u = (1.f - fabsf(n.z)) * ((n.x >= 0)? 1.f : -1.f);
+		v = (1.f - fabsf(n.x)) * ((n.z >= 0)? 1.f : -1.f);
+	}
+
+	// snorm, so straight up is exactly representable
+	uint8_t pu = int8_t(lroundf(u * 127.f));
+	uint8_t pv = int8_t(lroundf(v * 127.f));
+	return pu | (pv << 8);
+}
+
+// tree scattering. there's one candidate per treeSpacing-sized cell of a
+// world space grid, a candidate survives if no other candidate within
+// treeSpacing has a higher priority (matern type II thinning), which gives
+// blue noise with a guaranteed minimum distance. candidates only depend on
+// their own cell, so tiles agree on everything along their edges and the
+// same trees come out at every LOD.
+//
+// survivors are thinned again by elevation, from full density in the
+// lowlands to nothing at treeLine
+static const float    treeSpacing = 4.f;
+static const float    treeLine = 40.f;
+static const uint32_t treeSalt = 0x9e3779b9;
+static const uint32_t grassSalt = 0x5bd1e995;
+
+struct treeCandidate {
+	glm::vec2 pos;
+	uint32_t  priority;
+	// low bits for the density test, high bits for scale
+	uint32_t  bits;
+};
+
+// one more round of mixing to get more bits out of the lattice hash, a
+// full latticeHash() per field is most of the cost of scattering
+static inline uint32_t remix(uint32_t x) {
+	x ^= x >> 15;
+	x *= 0x2c1b3c6du;
+	x ^= x >> 12;
+	return x;
+}
+
+static treeCandidate treeCandidateAt(uint32_t seed, int32_t cx, int32_t cz) {
+	uint32_t h = latticeHash(seed ^ treeSalt, glm::ivec2(cx, cz));
+	uint32_t p = remix(h);
+	float jx = (h & 0xffff) / 65536.f;
+	float jz = (h >> 16) / 65536.f;
+
+	return {
+		glm::vec2((cx + jx)*treeSpacing, (cz + jz)*treeSpacing),
+		p,
+		remix(p),
+	};
+}
+
+// trees and grass both thin out going up to the tree line
+static float vegetationDensity(float height) {
+	return glm::clamp(1.f - height/treeLine, 0.f, 1.f);
+}
+
+unsigned maxTileTrees(float size) {
+	unsigned cells = unsigned(ceilf(size / treeSpacing)) + 1;
+	return cells * cells;
+}
+
+static void sampleTrees(tileData& data, float size) {
+	// one cell of margin for the neighbour checks
+	int32_t cx0 = int32_t(floorf(data.x / treeSpacing)) - 1;
+	int32_t cz0 = int32_t(floorf(data.z / treeSpacing)) - 1;
+	int32_t cx1 = int32_t(floorf((data.x + size) / treeSpacing)) + 1;
+	int32_t cz1 = int32_t(floorf((data.z + size) / treeSpacing)) + 1;
+	int32_t width = cx1 - cx0 + 1;
+	int32_t depth = cz1 - cz0 + 1;
+
+	std::vector<treeCandidate> cells(width * depth);
+
+	for (int32_t k = 0; k < depth; k++) {
+		for (int32_t i = 0; i < width; i++) {
+			cells[k*width + i] = treeCandidateAt(data.seed, cx0 + i, cz0 + k);
+		}
+	}
+
+	std::vector<glm::vec2> treepos;
+	std::vector<uint32_t>  treebits;
+	treepos.reserve(maxTileTrees(size));
+	treebits.reserve(maxTileTrees(size));
+	float minDist2 = treeSpacing * treeSpacing;
+
+	for (int32_t k = 1; k + 1 < depth; k++) {
+		for (int32_t i = 1; i + 1 < width; i++) {
+			const treeCandidate& c = cells[k*width + i];
+
+			// cells straddle tile edges, each candidate belongs to the
+			// tile it's in
+			if (c.pos.x < data.x || c.pos.x >= data.x + size
+			    || c.pos.y < data.z || c.pos.y >= data.z + size)
+			{
+				continue;
+			}
+
+			bool keep = true;
+
+			// ties drop both candidates, not worth breaking them for
+			// something that happens once in 2^32
+			for (int32_t dk = -1; keep && dk <= 1; dk++) {
+				for (int32_t di = -1; di <= 1; di++) {
+					const treeCandidate& o = cells[(k + dk)*width + (i + di)];
+
+					if (o.priority >= c.priority && (di || dk)) {
+						glm::vec2 d = o.pos - c.pos;
+
+						if (glm::dot(d, d) < minDist2) {
+							keep = false;
+							break;
+						}
+					}
+				}
+			}
+
+			if (keep) {
+				treepos.push_back(c.pos);
+				treebits.push_back(c.bits);
+			}
+		}
+	}
+
+	// heights for everything in one go, they're needed for the density
+	// test anyway
+	std::vector<float> treeheights(treepos.size());
+	landscapeThingPoints(data.seed, treepos.data(), treepos.size(), treeheights.data());
+
+	data.trees.clear();
+	data.trees.reserve(treepos.size());
+
+	for (size_t i = 0; i < treepos.size(); i++) {
+		float h = treeheights[i];
+		if ((treebits[i] & 0xffff) / 65536.f >= vegetationDensity(h)) {
+			continue;
+		}
+
+		float scale = (treebits[i] >> 16) / 65536.f * 3.f + 0.5f;
+		glm::vec2 off = treepos[i] - glm::vec2(data.x, data.z);
+		data.trees.push_back(glm::vec4(off.x, h - 0.1, off.y, scale));
+	}
+}
+
+// height of the tile mesh at (lx, lz) relative to the tile origin,
+// interpolated over the same triangles buildTileMesh() makes
+static float meshHeight(const tileData& data, float lx, float lz) {
+	unsigned res = data.samples;
+	float fx = lx / data.unit;
+	float fz = lz / data.unit;
+	unsigned i = std::min(unsigned(fx), res - 2);
+	unsigned k = std::min(unsigned(fz), res - 2);
+	const int16_t *q = &data.heights[k*res + i];
+	float a[4] = {float(q[0]), float(q[1]), float(q[res]), float(q[res + 1])};
+
+	fx -= i;
+	fz -= k;
+
+	// (a, c, b) below the diagonal, (b, c, d) above it
+	if (fx + fz <= 1.f) {
+		return (a[0] + (a[1] - a[0])*fx + (a[2] - a[0])*fz) * tileData::heightStep;
+	} else {
+		return (a[3] + (a[2] - a[3])*(1.f - fx)
+		             + (a[1] - a[3])*(1.f - fz)) * tileData::heightStep;
+	}
+}
+
+float tileData::surfaceHeight(float px, float pz) const {
+	// meshHeight() can't take anything outside the tile
+	float size = (samples - 1) * unit;
+	float lx = std::clamp(px - x, 0.f, size);
+	float lz = std::clamp(pz - z, 0.f, size);
+
+	return meshHeight(*this, lx, lz);
+}
+
+std::vector<grassChunk> sampleGrass(const tileData& data,
+                                    unsigned chunks,
+                                    unsigned perChunk)
+{
+	std::vector<grassChunk> ret(chunks * chunks);
+	float size = (data.samples - 1) * data.unit;
+	float chunkSize = size / chunks;
+	int32_t cx0 = int32_t(floorf(data.x / chunkSize + 0.5f));
+	int32_t cz0 = int32_t(floorf(data.z / chunkSize + 0.5f));
+
+	// R2 sequence, any prefix of it is about as evenly spread as the
+	// whole thing, so fewer instances per chunk is just a shorter prefix
+	const float a1 = 0.7548776662f;
+	const float a2 = 0.5698402910f;
+	std::vector<uint8_t> keep;
+
+	for (unsigned ck = 0; ck < chunks; ck++) {
+		for (unsigned ci = 0; ci < chunks; ci++) {
+			grassChunk& chunk = ret[ck*chunks + ci];
+			uint32_t h = latticeHash(data.seed ^ grassSalt,
+			                         glm::ivec2(cx0 + ci, cz0 + ck));
+			float ox = (h & 0xffff) / 65536.f;
+			float oz = (h >> 16) / 65536.f;
+
+			chunk.instances.resize(perChunk);
+			keep.resize(perChunk);
+
+			for (unsigned j = 0; j < perChunk; j++) {
+				float u = ox + (j + 1)*a1;
+				float v = oz + (j + 1)*a2;
+				u -= floorf(u);
+				v -= floorf(v);
+
+				float lx = (ci + u) * chunkSize;
+				float lz = (ck + v) * chunkSize;
+				float y = meshHeight(data, lx, lz);
+				uint32_t bits = remix(h + j*0x9e3779b9u);
+				float scale = (bits >> 16) / 65536.f * 0.6f + 0.7f;
+
+				chunk.instances[j] = glm::vec4(lx, y, lz, scale);
+				keep[j] = (bits & 0xffff) / 65536.f < vegetationDensity(y);
+			}
+
+			// compacted separately, whether an instance is kept is a
+			// coin toss that's expensive to branch on, and the
+			// samples above don't have to wait on each other this way
+			size_t count = 0;
+			for (unsigned j = 0; j < perChunk; j++) {
+				chunk.instances[count] = chunk.instances[j];
+				count += keep[j];
+			}
+
+			chunk.instances.resize(count);
+			chunk.min = glm::vec3(HUGE_VALF);
+			chunk.max = glm::vec3(-HUGE_VALF);
+
+			for (auto& inst : chunk.instances) {
+				glm::vec3 pos(inst.x, inst.y, inst.z);
+				chunk.min = glm::min(chunk.min, pos);
+				chunk.max = glm::max(chunk.max, pos);
+			}
+		}
+	}
+
+	return ret;
+}
+
+tileData sampleTile(uint32_t seed, float x, float z, float size, float unit,
+                    const bandRunner& bands)
+{
+	tileData ret;
+
+	ret.seed    = seed;
+	ret.x       = x;
+	ret.z       = z;
+	ret.unit    = unit;
+	ret.samples = unsigned(size/unit) + 1;
+
+	size_t count = ret.samples * ret.samples;
+	std::vector<float> scratch(3*count);
+	float *h  = scratch.data();
+	float *dx = h + count;
+	float *dz = dx + count;
+	ret.heights.resize(count);
+	ret.normals.resize(count);
+
+	// rows of heights and slopes, no need to sample past the edges, then
+	// straight into the packed layout
+	auto sampleRows = [&] (unsigned first, unsigned rows) {
+		size_t off = first * ret.samples;
+		size_t end = off + rows * ret.samples;
+
+		landscapeThingGridGradientRows(seed, x, z, unit, ret.samples,
+		                               first, rows, h + off, dx + off, dz + off);
+
+		for (size_t i = off; i < end; i++) {
+			ret.heights[i] = tileData::packHeight(h[i]);
+			ret.normals[i] = tileData::packNormal(glm::vec3(-dx[i], 1, -dz[i]));
+		}
+	};
+
+	unsigned nbands = ret.samples / minBandRows;
+
+	if (!bands || nbands < 2) {
+		sampleRows(0, ret.samples);
+		sampleTrees(ret, size);
+		return ret;
+	}
+
+	// trees don't need the heights, they go alongside the last band
+	bands(nbands + 1, [&] (unsigned band) {
+		if (band == nbands) {
+			sampleTrees(ret, size);
+			return;
+		}
+
+		unsigned first = band * ret.samples / nbands;
+		unsigned last  = (band + 1) * ret.samples / nbands;
+		sampleRows(first, last - first);
+	});
+
+	return ret;
+}
+
+// every tile at a resolution shares one index buffer
+static std::mutex indicesMtx;
+static std::map<unsigned, std::shared_ptr<const std::vector<uint32_t>>> meshIndices;
+
+// grid triangles then skirts, skirt vertices come after the grid ones in
+// the same order as tileEdgeVertex()
+static std::shared_ptr<const std::vector<uint32_t>> buildIndices(unsigned res) {
+	auto ret = std::make_shared<std::vector<uint32_t>>();
+	unsigned edges = 4*(res - 1);
+	uint32_t base = res*res;
+	int mid = res - 1;
+
+	ret->reserve(6*(res - 1)*(res - 1) + 6*edges);
+
+	for (unsigned k = 0; k + 1 < res; k++) {
+		for (unsigned i = 0; i + 1 < res; i++) {
+			uint32_t a = k*res + i;
+			uint32_t b = a + 1;
+			uint32_t c = a + res;
+			uint32_t d = c + 1;
+
+			// counter-clockwise seen from above
+			ret->insert(ret->end(), {a, c, b, b, c, d});
+		}
+	}
+
+	for (unsigned j = 0; j < edges; j++) {
+		unsigned next = (j + 1) % edges;
+		uint32_t top[2] = {tileEdgeVertex(res, j), tileEdgeVertex(res, next)};
+		uint32_t bottom[2] = {base + j, base + next};
+
+		// skirts face away from the tile, the bottom edge is straight
+		// below the top one so this only depends on where the edge is.
+		// all doubled to stay on integers
+		int ex = int(top[1] % res) - int(top[0] % res);
+		int ez = int(top[1] / res) - int(top[0] / res);
+		int ox = int(top[0] % res + top[1] % res) - mid;
+		int oz = int(top[0] / res + top[1] / res) - mid;
+
+		if (ex*oz - ez*ox < 0) {
+			std::swap(top[0], top[1]);
+			std::swap(bottom[0], bottom[1]);
+		}
+
+		ret->insert(ret->end(), {
+			top[0], bottom[0], top[1],
+			top[1], bottom[0], bottom[1],
+		});
+	}
+
+	return ret;
+}
+
+std::shared_ptr<const std::vector<uint32_t>> tileIndices(unsigned res) {
+	std::lock_guard<std::mutex> g(indicesMtx);
+	auto& indices = meshIndices[res];
+
+	if (!indices) {
+		indices = buildIndices(res);
+	}
+
+	return indices;
+}
+
+size_t tileIndexBuffers(void) {
+	std::lock_guard<std::mutex> g(indicesMtx);
+	return meshIndices.size();
+}
+
+tileMesh buildTileMesh(const tileData& data, float skirtDepth) {
+	tileMesh ret;
+	size_t count = tileVertexCount(data.resolution());
+
+	ret.positions.resize(count);
+	ret.normals.resize(count);
+	ret.uvs.resize(count);
+	ret.indices = tileIndices(data.resolution());
+
+	tileVertices(data, skirtDepth,
+		[&] (size_t i, glm::vec3 pos, glm::vec3 normal, glm::vec2 uv) {
+			ret.positions[i] = pos;
+			ret.normals[i] = normal;
+			ret.uvs[i] = uv;
+		});
+
+	return ret;
+}
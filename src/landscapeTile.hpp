@@ -0,0 +1,167 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <functional>
+#include <memory>
+#include <math.h>
+#include <vector>
+#include <stdint.h>
+
+// CPU-side data for one landscape tile, everything needed to build the
+// renderable and physics objects without evaluating the noise again.
+// doesn't depend on anything from the engine, so it can be sampled on any
+// thread and written to/read from the tile store as-is.
+struct tileData {
+	// about 4mm, good for +-128m
+	static constexpr float heightStep = 1.f/256;
+
+	uint32_t seed;
+	// tile origin in world space, and sample spacing
+	float x, z, unit;
+	// samples per side, the first and last samples are on the tile edges
+	unsigned samples;
+	// samples*samples heights, sample (i, k) is at
+	// (x + i*unit, z + k*unit). stored in steps of heightStep, which the
+	// heightfield collider takes as-is. x, z and uvs all follow from the
+	// index, so this and the normals are all there is per vertex
+	std::vector<int16_t> heights;
+	// normals from the analytic noise gradient, same layout as heights,
+	// octahedral packed into 8 bits per axis. neighbouring tiles get
+	// exactly the same normals along shared edges
+	std::vector<uint16_t> normals;
+	// tree instances relative to the tile origin, xyz position, w scale.
+	// blue noise, thinning out with elevation, see sampleTrees(). y is
+	// off the full detail noise whatever the spacing, the same for
+	// every level, use surfaceHeight() to put them on the tile mesh
+	std::vector<glm::vec4> trees;
+
+	unsigned resolution(void) const { return samples; }
+
+	float height(size_t i) const { return heights[i] * heightStep; }
+	glm::vec3 normal(size_t i) const { return unpackNormal(normals[i]); }
+
+	static int16_t packHeight(float h);
+	static uint16_t packNormal(glm::vec3 n);
+
+	static glm::vec3 unpackNormal(uint16_t packed) {
+		float u = int8_t(packed & 0xff) / 127.f;
+		float v = int8_t(packed >> 8) / 127.f;
+		glm::vec3 n = glm::vec3(u, 1.f - fabsf(u) - fabsf(v), v);
+
+		// lower half is folded over the diagonals
+		if (n.y < 0) {
+			float t = -n.y;
+			n.x += (n.x >= 0)? -t : t;
+			n.z += (n.z >= 0)? -t : t;
+		}
+
+		return glm::normalize(n);
+	}
+
+	// height lookup, falls back to evaluating the noise for anything
+	// that isn't on the sample grid
+	float operator()(float px, float pz) const;
+	// height of the tile mesh at a world position, clamped to the tile.
+	// this is the surface things actually stand on at the tile's LOD
+	float surfaceHeight(float px, float pz) const;
+
+	size_t bytes(void) const {
+		return sizeof(*this)
+			+ heights.size() * sizeof(heights[0])
+			+ normals.size() * sizeof(normals[0])
+			+ trees.size() * sizeof(trees[0]);
+	}
+};
+
+// triangle mesh for a tile, positions relative to the tile origin.
+// each tile gets a skirt hanging down from its edges, tiles with different
+// sample spacings don't share all of their edge vertices, the skirts cover
+// the gaps so neighbouring LOD levels don't need to know about each other
+struct tileMesh {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+	// every tile at the same resolution has the same topology, they
+	// all share one index buffer
+	std::shared_ptr<const std::vector<uint32_t>> indices;
+};
+
+// grass for one square chunk of a tile
+struct grassChunk {
+	// bounds of the instances relative to the tile origin, min > max if
+	// there aren't any
+	glm::vec3 min, max;
+	// xyz position relative to the tile origin, w scale
+	std::vector<glm::vec4> instances;
+};
+
+// runs fn(0) .. fn(count - 1) and returns once they're all done, possibly
+// spread over other threads
+typedef std::function<void(unsigned count, std::function<void(unsigned)> fn)>
+	bandRunner;
+
+// tiles with at least 2*minBandRows samples per side are sampled in bands
+// of rows through bands, if given. smaller ones aren't worth splitting
+static const unsigned minBandRows = 16;
+
+tileData sampleTile(uint32_t seed, float x, float z, float size, float unit,
+                    const bandRunner& bands = nullptr);
+// grass over chunks*chunks chunks of the tile, at most perChunk instances
+// each. a smaller perChunk gives a subset of the same instances, spread
+// out just as evenly. heights are taken from the tile mesh rather than
+// the noise, so grass sits on whatever level of detail the tile is at
+std::vector<grassChunk> sampleGrass(const tileData& data, unsigned chunks,
+                                    unsigned perChunk);
+tileMesh buildTileMesh(const tileData& data, float skirtDepth);
+// index buffer shared by every tile mesh at a resolution, grid triangles
+// then skirts, and how many of them have been made (one per resolution)
+std::shared_ptr<const std::vector<uint32_t>> tileIndices(unsigned res);
+size_t tileIndexBuffers(void);
+
+// vertices in a tile mesh, res*res grid vertices then 4*(res - 1) skirt
+// vertices, see tileVertices()
+static inline size_t tileVertexCount(unsigned res) {
+	return res*res + 4*(res - 1);
+}
+
+// n-th grid vertex going around the edge of the tile, skirt vertex j
+// hangs below this one
+static inline uint32_t tileEdgeVertex(unsigned res, unsigned j) {
+	unsigned n = res - 1;
+	unsigned t = j % n;
+
+	switch (j / n) {
+		case 0:  return t;
+		case 1:  return t*res + n;
+		case 2:  return n*res + (n - t);
+		default: return (n - t)*res;
+	}
+}
+
+// calls fn(index, position, normal, uv) for every vertex of the tile mesh,
+// positions relative to the tile origin. anything that holds a tile mesh
+// (tileMesh, the generator's models) is filled in through this, so they
+// all come out the same
+template <typename F>
+void tileVertices(const tileData& data, float skirtDepth, F fn) {
+	unsigned res = data.resolution();
+	unsigned edges = 4*(res - 1);
+
+	auto grid = [&] (uint32_t v, size_t index, float drop) {
+		unsigned i = v % res;
+		unsigned k = v / res;
+
+		fn(index, glm::vec3(i*data.unit, data.height(v) - drop, k*data.unit),
+		   data.normal(v), glm::vec2(i, k) / float(res - 1));
+	};
+
+	for (uint32_t v = 0; v < res*res; v++) {
+		grid(v, v, 0.f);
+	}
+
+	for (unsigned j = 0; j < edges; j++) {
+		grid(tileEdgeVertex(res, j), res*res + j, skirtDepth);
+	}
+}
+// upper bound on data.trees.size() for a tile of the given size
+unsigned maxTileTrees(float size);
@@ -43,6 +43,10 @@ class landscapeEventSystem : public entitySystem {
 		virtual void update(entityManager *manager, float delta);
 
 		generatorEventQueue::ptr queue = std::make_shared<generatorEventQueue>();
+
+	private:
+		// drained into here each update, kept around for the capacity
+		std::vector<generatorEvent> events;
 };
 
 class generatorEventHandler : public component {
@@ -102,10 +106,12 @@ class generatorEventActivator : public generatorEventHandler {
 
 void landscapeEventSystem::update(entityManager *manager, float delta) {
 	auto handlers = manager->getComponents("generatorEventHandler");
-	auto g = queue->lock();
-	auto& quevec = queue->getQueue();
 
-	for (auto& ev : quevec) {
+	// handlers run on our own copy, the queue is free for new events
+	// the whole time
+	queue->drain(events);
+
+	for (auto& ev : events) {
 		for (auto& it : handlers) {
 			generatorEventHandler *handler = dynamic_cast<generatorEventHandler*>(it);
 			entity *ent = manager->getEntity(handler);
@@ -115,9 +121,6 @@ void landscapeEventSystem::update(entityManager *manager, float delta) {
 			}
 		}
 	}
-
-	// XXX: should be in queue class
-	quevec.clear();
 }
 
 // XXX: this sort of makes sense but not really... game entity with no renderable
@@ -240,13 +243,21 @@ landscapeGenView::landscapeGenView(gameMain *game) : gameView() {
 	game->entities->add(new worldEntitySpawner(game->entities.get()));
 	*/
 
-	for (unsigned i = 0; i < 10; i++) {
-		glm::vec3 position = glm::vec3(
+	// dropped in a little above the ground rather than from a fixed height
+	glm::vec2 spawns[10];
+	float heights[10];
+
+	for (auto& p : spawns) {
+		p = glm::vec2(
 			float(rand()) / RAND_MAX * 100.0 - 50,
-			50.0,
 			float(rand()) / RAND_MAX * 100.0 - 50
 		);
+	}
+
+	landscape.heightsAt(spawns, 10, heights);
 
+	for (unsigned i = 0; i < 10; i++) {
+		glm::vec3 position = glm::vec3(spawns[i].x, heights[i] + 2.f, spawns[i].y);
 		game->entities->add(new enemy(game->entities.get(), game, position));
 	}
 
@@ -300,6 +311,9 @@ void landscapeGenView::logic(gameMain *game, float delta) {
 	game->phys->stepSimulation(delta);
 	game->phys->filterCollisions();;
 	
+	// finished tiles go up whether or not there's a player to follow
+	landscape.update(game);
+
 	entity *playerEnt = findFirst(game->entities.get(), {"player"});
 
 	if (!playerEnt) {
@@ -328,8 +342,12 @@ void landscapeGenView::logic(gameMain *game, float delta) {
 
 	if (playerEnt) {
 		TRS& transform = playerEnt->getNode()->transform;
+		rigidBody *body;
+		castEntityComponent(body, game->entities.get(), playerEnt, "rigidBody");
+
+		glm::vec3 velocity = body? body->phys->getVelocity() : glm::vec3(0);
 		cam->setPosition(transform.position - zoom*cam->direction());
-		landscape.setPosition(game, transform.position);
+		landscape.setPosition(game, transform.position, velocity);
 	}
 
 	game->entities->update(delta);
@@ -573,6 +591,7 @@ int main(int argc, char *argv[]) {
 		game->phys->addStaticModels(nullptr, game->state->rootnode, staticPosition);
 
 		landscapeGenView::ptr player = std::make_shared<landscapeGenView>(game);
+		player->landscape.openTileStore("landscape.tiles");
 		player->landscape.setPosition(game, glm::vec3(1));
 		player->cam->setFar(1000.0);
 		game->setView(player);
@@ -0,0 +1,456 @@
+// microbenchmarks and golden values for the landscape noise.
+//
+//   noise-bench [check|bench|golden]
+//
+// check compares the scalar functions and every batched kernel this build
+// and CPU can run against values recorded from the current terrain, and
+// exits with 1 on any difference. bench reports ns per sample for each of
+// them over a few input ranges. without an argument it does both.
+//
+// golden prints a new table for the top of this file. only do that when the
+// terrain is meant to change, and bump storeVersion in tileStore.cpp when
+// you do.
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "landscapeNoise.hpp"
+#include "landscapeNoiseInternal.hpp"
+
+static const uint32_t goldenSeed = 0xcafebabe;
+
+struct goldenPoint {
+	float x, y;
+	// perlinNoise(), landscapeThing() and the landscapeThingGradient()
+	// gradient at (x, y)
+	float perlin, height, dx, dy;
+};
+
+// generated with noise-bench golden
+static const goldenPoint goldenPoints[] = {
+	{0x0p+0f, 0x0p+0f, 0x0p+0f, 0x0p+0f, 0x0p+0f, 0x0p+0f},
+	{0x1.2cp+6f, 0x1.4p+4f, 0x0p+0f, 0x0p+0f, 0x0p+0f, 0x0p+0f},
+	{-0x1.0624dep-10f, 0x1.0624dep-10f, 0x1.69fa7p-10f, 0x1.3d18d8p-8f, -0x1.35904ap+2f, -0x1.6f7e8p-12f},
+	{-0x1p+0f, -0x1p+0f, 0x0p+0f, 0x1.149ffap+2f, -0x1.7f1a3cp+1f, -0x1.d0c5dcp-2f},
+	{-0x1.19999ap+1f, 0x1.f33334p+1f, 0x1.7753fp-5f, 0x1.893acep+2f, -0x1.335a8cp+1f, -0x1.d49948p-1f},
+	{0x1.8ae148p+3f, -0x1.c63d7p+5f, 0x0p+0f, 0x1.c5694p+3f, 0x1.252742p-1f, -0x1.da36ccp-3f},
+	{0x1.8p+4f, 0x1.8p+5f, 0x0p+0f, 0x1.8ffd4cp+1f, 0x1.4ab648p-1f, -0x1.f08e38p-3f},
+	{-0x1.8p+4f, -0x1.8p+5f, 0x0p+0f, 0x1.452834p+3f, -0x1.e36a88p-1f, 0x1.b15a0ap-1f},
+	{-0x1.ep+2f, -0x1.68p+3f, 0x0p+0f, 0x1.cd459cp+3f, -0x1.8d7b22p-1f, 0x1.1ff334p+0f},
+	{-0x1.e4ccccp+5f, 0x1.1b3334p+4f, 0x1.d25deep-2f, 0x1.69d0ep+4f, 0x1.a381d6p-2f, -0x1.63b238p-3f},
+	{0x1.8f999ap+6f, 0x1.99999ap-4f, 0x0p+0f, 0x1.00527cp-4f, -0x1.655f46p-1f, -0x1.3d249p-4f},
+	{-0x1.2c8p+7f, 0x1.2c8p+8f, 0x1.f85f58p-5f, 0x1.5b1d0ap+0f, -0x1.04cffp-2f, -0x1.5c8c04p-2f},
+	{0x1.f40cccp+9f, -0x1.f40cccp+10f, 0x1.3e3c6ap-3f, 0x1.138aep-2f, 0x1.deea44p-1f, -0x1.73142ap-1f},
+	{-0x1.0e18p+12f, 0x1.349p+10f, 0x0p+0f, 0x1.bffb64p+0f, -0x1.a363f2p-2f, -0x1.6459fp-1f},
+	{0x1.00008p+16f, -0x1.00008p+16f, 0x1.e0876p-6f, 0x1.a277eep+2f, -0x1.05c13p-5f, -0x1.3134aap-2f},
+	{0x1.e240b4p+16f, 0x1.de64ccp+12f, 0x0p+0f, 0x1.e8c4fp-1f, 0x1.6c5236p-3f, -0x1.0cbaa4p-3f},
+	{0x1.e8482p+18f, -0x1.e8482p+17f, 0x1.4705d8p-2f, 0x1.4ef57p+0f, 0x1.76612ap+0f, -0x1.2685a4p+0f},
+	{0x1.e848p+19f, -0x1.e847fp+19f, 0x0p+0f, 0x1.5395ccp+4f, 0x1.35fa4ap+0f, 0x1.05ede6p-1f},
+};
+
+static const uint64_t goldenGradientHash     = 0xcc815854fa836231ull;
+static const uint64_t goldenGridHash         = 0x5cb9513d56873d39ull;
+static const uint64_t goldenGridGradientHash = 0x44678b1efa773187ull;
+static const uint64_t goldenRowHash          = 0xcfb3a9ad6a5ae920ull;
+static const uint64_t goldenPointsHash       = 0x474c73be1839e39dull;
+
+// a few of these are in flat areas where the noise is clamped to zero
+static const glm::vec2 goldenInputs[] = {
+	{0.f, 0.f},               {75.f, 20.f},            {-0.001f, 0.001f},
+	{-1.f, -1.f},             {-2.2f, 3.9f},           {12.34f, -56.78f},
+	{24.f, 48.f},             {-24.f, -48.f},          {-7.5f, -11.25f},
+	{-60.6f, 17.7f},          {99.9f, 0.1f},           {-150.25f, 300.5f},
+	{1000.1f, -2000.2f},      {-4321.5f, 1234.25f},    {65536.5f, -65536.5f},
+	{123456.7f, 7654.3f},     {500000.5f, -250000.25f}, {1e6f, -999999.5f},
+};
+
+static const unsigned numGolden = sizeof(goldenInputs)/sizeof(goldenInputs[0]);
+static_assert(sizeof(goldenPoints)/sizeof(goldenPoints[0]) == numGolden,
+              "golden table out of date, regenerate it");
+
+// grids (and rows, using the first row) hashed for the batched checks,
+// somewhere ordinary, at a fine spacing far from the origin, and coarse
+struct goldenGrid {
+	float x, y, unit;
+	size_t width, depth;
+};
+
+static const goldenGrid goldenGrids[] = {
+	{-100.5f, 37.25f, 2.f, 65, 65},
+	{65536.f, -131072.f, 0.5f, 33, 17},
+	{100000.25f, -30000.f, 8.f, 40, 40},
+};
+
+static uint64_t hashFloats(uint64_t h, const float *values, size_t count) {
+	// FNV-1a over the bit patterns, so -0 and 0 count as different
+	for (size_t i = 0; i < count; i++) {
+		uint32_t bits;
+		memcpy(&bits, &values[i], sizeof(bits));
+
+		for (unsigned b = 0; b < 4; b++) {
+			h ^= (bits >> (8*b)) & 0xff;
+			h *= 0x100000001b3ull;
+		}
+	}
+
+	return h;
+}
+
+static const uint64_t hashStart = 0xcbf29ce484222325ull;
+
+static std::vector<glm::vec2> goldenPointList(void) {
+	std::vector<glm::vec2> ret;
+	uint32_t state = 1234;
+
+	auto next = [&] {
+		state = state*1664525u + 1013904223u;
+		return (state >> 8) / float(1 << 24);
+	};
+
+	for (unsigned i = 0; i < 1000; i++) {
+		float scale = (i < 500)? 200.f : 200000.f;
+		float x = (next() - 0.5f) * scale;
+		float y = (next() - 0.5f) * scale;
+		ret.push_back(glm::vec2(x, y));
+	}
+
+	return ret;
+}
+
+struct batchedHashes {
+	uint64_t grid = hashStart;
+	uint64_t gridGradient = hashStart;
+	uint64_t row = hashStart;
+	uint64_t points = hashStart;
+};
+
+static batchedHashes hashBatched(void) {
+	batchedHashes ret;
+
+	for (auto& g : goldenGrids) {
+		size_t n = g.width * g.depth;
+		std::vector<float> out(n), dx(n), dy(n);
+
+		landscapeThingGrid(goldenSeed, g.x, g.y, g.unit, g.width, g.depth, out.data());
+		ret.grid = hashFloats(ret.grid, out.data(), n);
+
+		landscapeThingGridGradient(goldenSeed, g.x, g.y, g.unit, g.width, g.depth,
+		                           out.data(), dx.data(), dy.data());
+		ret.gridGradient = hashFloats(ret.gridGradient, out.data(), n);
+		ret.gridGradient = hashFloats(ret.gridGradient, dx.data(), n);
+		ret.gridGradient = hashFloats(ret.gridGradient, dy.data(), n);
+
+		landscapeThingRow(goldenSeed, g.x, g.y, g.unit, g.width, out.data());
+		ret.row = hashFloats(ret.row, out.data(), g.width);
+	}
+
+	auto points = goldenPointList();
+	std::vector<float> out(points.size());
+	landscapeThingPoints(goldenSeed, points.data(), points.size(), out.data());
+	ret.points = hashFloats(ret.points, out.data(), out.size());
+
+	return ret;
+}
+
+static uint64_t hashGradients(void) {
+	uint64_t h = hashStart;
+
+	for (int y = -8; y < 8; y++) {
+		for (int x = -8; x < 8; x++) {
+			glm::vec2 g = randomGradient(goldenSeed, glm::ivec2(x*4099, y*7919));
+			h = hashFloats(h, &g.x, 1);
+			h = hashFloats(h, &g.y, 1);
+		}
+	}
+
+	return h;
+}
+
+struct kernelInfo {
+	const char *name;
+	noiseKernel kernel;
+};
+
+static const kernelInfo kernels[] = {
+	{"scalar", noiseKernel::scalar},
+	{"sse2",   noiseKernel::sse2},
+	{"avx2",   noiseKernel::avx2},
+	{"fma",    noiseKernel::fma},
+};
+
+static bool sameBits(float a, float b) {
+	return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+static bool check(void) {
+	unsigned failures = 0;
+
+	auto expect = [&] (bool ok, const char *what) {
+		if (!ok) {
+			printf("  MISMATCH: %s\n", what);
+			failures++;
+		}
+	};
+
+	printf("checking against golden values, seed 0x%x\n", goldenSeed);
+
+	for (unsigned i = 0; i < numGolden; i++) {
+		const goldenPoint& p = goldenPoints[i];
+		glm::vec2 grad;
+		float perlin = perlinNoise(goldenSeed, p.x, p.y);
+		float height = landscapeThing(goldenSeed, p.x, p.y);
+		float gheight = landscapeThingGradient(goldenSeed, p.x, p.y, grad);
+
+		std::string where = "(" + std::to_string(p.x) + ", " + std::to_string(p.y) + ")";
+		expect(sameBits(perlin, p.perlin), ("perlinNoise " + where).c_str());
+		expect(sameBits(height, p.height), ("landscapeThing " + where).c_str());
+		expect(sameBits(gheight, p.height), ("landscapeThingGradient height " + where).c_str());
+		expect(sameBits(grad.x, p.dx) && sameBits(grad.y, p.dy),
+		       ("landscapeThingGradient gradient " + where).c_str());
+	}
+
+	expect(hashGradients() == goldenGradientHash, "randomGradient");
+
+	for (auto& k : kernels) {
+		if (!setNoiseKernel(k.kernel)) {
+			printf("  %-8s not available\n", k.name);
+			continue;
+		}
+
+		batchedHashes h = hashBatched();
+		bool exact = h.grid == goldenGridHash && h.gridGradient == goldenGridGradientHash
+		          && h.row == goldenRowHash && h.points == goldenPointsHash;
+
+		// FMA rounds differently, that's what LANDSCAPE_REPRODUCIBLE is for
+		if (k.kernel == noiseKernel::fma) {
+			printf("  %-8s %s (not expected to match)\n", k.name,
+			       exact? "matches" : "differs");
+			continue;
+		}
+
+		printf("  %-8s %s\n", k.name, exact? "ok" : "differs");
+		std::string name = k.name;
+		expect(h.grid == goldenGridHash, (name + " landscapeThingGrid").c_str());
+		expect(h.gridGradient == goldenGridGradientHash,
+		       (name + " landscapeThingGridGradient").c_str());
+		expect(h.row == goldenRowHash, (name + " landscapeThingRow").c_str());
+		expect(h.points == goldenPointsHash, (name + " landscapeThingPoints").c_str());
+	}
+
+	setNoiseKernel(noiseKernel::automatic);
+	printf("%s, %u mismatches\n", failures? "FAILED" : "passed", failures);
+	return failures == 0;
+}
+
+static void printGolden(void) {
+	setNoiseKernel(noiseKernel::scalar);
+
+	for (unsigned i = 0; i < numGolden; i++) {
+		glm::vec2 in = goldenInputs[i];
+		glm::vec2 grad;
+		landscapeThingGradient(goldenSeed, in.x, in.y, grad);
+
+		printf("\t{%af, %af, %af, %af, %af, %af},\n", in.x, in.y,
+		       perlinNoise(goldenSeed, in.x, in.y),
+		       landscapeThing(goldenSeed, in.x, in.y),
+		       grad.x, grad.y);
+	}
+
+	batchedHashes h = hashBatched();
+	printf("\nstatic const uint64_t goldenGradientHash     = 0x%016llxull;\n",
+	       (unsigned long long)hashGradients());
+	printf("static const uint64_t goldenGridHash         = 0x%016llxull;\n",
+	       (unsigned long long)h.grid);
+	printf("static const uint64_t goldenGridGradientHash = 0x%016llxull;\n",
+	       (unsigned long long)h.gridGradient);
+	printf("static const uint64_t goldenRowHash          = 0x%016llxull;\n",
+	       (unsigned long long)h.row);
+	printf("static const uint64_t goldenPointsHash       = 0x%016llxull;\n",
+	       (unsigned long long)h.points);
+
+	setNoiseKernel(noiseKernel::automatic);
+}
+
+typedef std::chrono::steady_clock benchClock;
+
+// keeps the compiler from throwing results away
+static volatile float sink;
+
+// runs func (which handles samples samples per call) for at least 50ms,
+// returns ns per sample
+template <typename F>
+static double nsPerSample(size_t samples, F func) {
+	size_t calls = 0;
+	auto start = benchClock::now();
+	double elapsed;
+
+	do {
+		func();
+		calls++;
+		elapsed = std::chrono::duration<double, std::nano>(benchClock::now() - start).count();
+	} while (elapsed < 50e6);
+
+	return elapsed / (calls * samples);
+}
+
+struct benchRange {
+	const char *name;
+	float x, y;
+};
+
+static const benchRange ranges[] = {
+	{"origin", 0.f, 0.f},
+	{"negative", -5000.f, -3000.f},
+	{"far", 100000.f, 250000.f},
+};
+
+static void bench(void) {
+	const size_t side = 128;
+	const float unit = 2.f;
+
+	printf("ns per sample, %zux%zu samples at %gm spacing\n", side, side, unit);
+	printf("%-28s", "");
+	for (auto& r : ranges) {
+		printf(" %10s", r.name);
+	}
+	printf("\n");
+
+	auto row = [&] (const char *name, auto func) {
+		printf("%-28s", name);
+		for (auto& r : ranges) {
+			printf(" %10.2f", func(r));
+		}
+		printf("\n");
+		fflush(stdout);
+	};
+
+	std::vector<float> out(side*side), dx(side*side), dy(side*side);
+	std::vector<glm::vec2> points(side*side);
+
+	row("randomGradient", [&] (const benchRange& r) {
+		return nsPerSample(side*side, [&] {
+			float acc = 0;
+			for (size_t k = 0; k < side; k++) {
+				for (size_t i = 0; i < side; i++) {
+					acc += randomGradient(goldenSeed,
+						glm::ivec2(int(r.x) + i, int(r.y) + k)).x;
+				}
+			}
+			sink = acc;
+		});
+	});
+
+	row("perlinNoise", [&] (const benchRange& r) {
+		return nsPerSample(side*side, [&] {
+			float acc = 0;
+			for (size_t k = 0; k < side; k++) {
+				for (size_t i = 0; i < side; i++) {
+					acc += perlinNoise(goldenSeed, (r.x + i*unit)/20.f,
+					                               (r.y + k*unit)/20.f);
+				}
+			}
+			sink = acc;
+		});
+	});
+
+	row("landscapeThing", [&] (const benchRange& r) {
+		return nsPerSample(side*side, [&] {
+			float acc = 0;
+			for (size_t k = 0; k < side; k++) {
+				for (size_t i = 0; i < side; i++) {
+					acc += landscapeThing(goldenSeed, r.x + i*unit, r.y + k*unit);
+				}
+			}
+			sink = acc;
+		});
+	});
+
+	row("landscapeThingGradient", [&] (const benchRange& r) {
+		return nsPerSample(side*side, [&] {
+			float acc = 0;
+			glm::vec2 grad;
+			for (size_t k = 0; k < side; k++) {
+				for (size_t i = 0; i < side; i++) {
+					acc += landscapeThingGradient(goldenSeed, r.x + i*unit,
+					                              r.y + k*unit, grad);
+				}
+			}
+			sink = acc;
+		});
+	});
+
+	for (auto& k : kernels) {
+		if (!setNoiseKernel(k.kernel)) {
+			continue;
+		}
+
+		std::string name = k.name;
+
+		row((name + " grid").c_str(), [&] (const benchRange& r) {
+			return nsPerSample(side*side, [&] {
+				landscapeThingGrid(goldenSeed, r.x, r.y, unit, side, side, out.data());
+				sink = out[side];
+			});
+		});
+
+		row((name + " grid gradient").c_str(), [&] (const benchRange& r) {
+			return nsPerSample(side*side, [&] {
+				landscapeThingGridGradient(goldenSeed, r.x, r.y, unit, side, side,
+				                           out.data(), dx.data(), dy.data());
+				sink = dx[side];
+			});
+		});
+
+		row((name + " row").c_str(), [&] (const benchRange& r) {
+			return nsPerSample(side, [&] {
+				landscapeThingRow(goldenSeed, r.x, r.y, unit, side, out.data());
+				sink = out[1];
+			});
+		});
+
+		row((name + " points").c_str(), [&] (const benchRange& r) {
+			for (size_t i = 0; i < points.size(); i++) {
+				// scattered over the same area as the grid
+				uint32_t h = latticeHash(goldenSeed, glm::ivec2(i, 0));
+				points[i] = glm::vec2(r.x + (h & 0xffff) / 65536.f * side*unit,
+				                      r.y + (h >> 16) / 65536.f * side*unit);
+			}
+
+			return nsPerSample(points.size(), [&] {
+				landscapeThingPoints(goldenSeed, points.data(), points.size(), out.data());
+				sink = out[1];
+			});
+		});
+	}
+
+	setNoiseKernel(noiseKernel::automatic);
+}
+
+int main(int argc, char *argv[]) {
+	std::string mode = (argc > 1)? argv[1] : "all";
+
+	if (mode == "golden") {
+		printGolden();
+		return 0;
+	}
+
+	if (mode != "all" && mode != "check" && mode != "bench") {
+		fprintf(stderr, "usage: %s [check|bench|golden]\n", argv[0]);
+		return 1;
+	}
+
+	bool passed = true;
+
+	if (mode != "bench") {
+		passed = check();
+	}
+
+	if (mode != "check") {
+		bench();
+	}
+
+	return passed? 0 : 1;
+}
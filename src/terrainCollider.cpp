@@ -0,0 +1,191 @@
+#include <grend/gameMain.hpp>
+#include <grend/bulletPhysics.hpp>
+#include <atomic>
+#include "terrainCollider.hpp"
+#include "terrainShape.hpp"
+
+static std::atomic<size_t> attachedColliders(0);
+static std::atomic<size_t> aliveColliders(0);
+static std::atomic<size_t> colliderAttaches(0);
+static std::atomic<size_t> colliderDetaches(0);
+
+// XXX: grend's physics interface doesn't have heightfields (or a way to
+//      count objects), so this goes around it to the bullet world
+static btDiscreteDynamicsWorld *bulletWorld(gameMain *game) {
+	auto bullet = std::dynamic_pointer_cast<bulletPhysics>(game->phys);
+	return bullet? bullet->world : nullptr;
+}
+
+terrainCollider::terrainCollider() {
+	aliveColliders++;
+}
+
+terrainCollider::~terrainCollider() {
+	// subclasses detach themselves, removeFromWorld() is gone by now
+	aliveColliders--;
+}
+
+bool terrainCollider::attach(gameMain *game) {
+	if (attached) {
+		return true;
+	}
+
+	if (!addToWorld(game)) {
+		return false;
+	}
+
+	attached = true;
+	attachedColliders++;
+	colliderAttaches++;
+	return true;
+}
+
+void terrainCollider::detach(void) {
+	if (!attached) {
+		return;
+	}
+
+	removeFromWorld();
+	attached = false;
+	attachedColliders--;
+	colliderDetaches++;
+}
+
+terrainCollider::counters terrainCollider::getCounters(void) {
+	return {
+		.attached = attachedColliders,
+		.alive    = aliveColliders,
+		.attaches = colliderAttaches,
+		.detaches = colliderDetaches,
+	};
+}
+
+class heightfieldCollider : public terrainCollider {
+	public:
+		heightfieldCollider(const tileData& data)
+			: shape(makeHeightfieldShape(data))
+		{
+			btRigidBody::btRigidBodyConstructionInfo
+				info(0, nullptr, shape.shape.get());
+			info.m_startWorldTransform = shape.transform;
+
+			body = std::make_unique<btRigidBody>(info);
+			body->setCollisionFlags(body->getCollisionFlags()
+			                        | btCollisionObject::CF_STATIC_OBJECT);
+		}
+
+		virtual ~heightfieldCollider() {
+			detach();
+		}
+
+		virtual size_t bytes(void) {
+			return shape.bytes + sizeof(btRigidBody);
+		}
+
+		virtual const char *kind(void) {
+			return "heightfield";
+		}
+
+	protected:
+		virtual bool addToWorld(gameMain *game) {
+			if (!(world = bulletWorld(game))) {
+				return false;
+			}
+
+			world->addRigidBody(body.get());
+			return true;
+		}
+
+		virtual void removeFromWorld(void) {
+			world->removeRigidBody(body.get());
+			world = nullptr;
+		}
+
+	private:
+		terrainShape shape;
+		std::unique_ptr<btRigidBody> body;
+		btDiscreteDynamicsWorld *world = nullptr;
+};
+
+class meshCollider : public terrainCollider {
+	public:
+		meshCollider(gameModel::ptr source) {
+			gameModel::ptr model = std::make_shared<gameModel>();
+			model->vertices = source->vertices;
+			model->transform = source->transform;
+
+			auto mesh = std::dynamic_pointer_cast<gameMesh>(source->getNode("mesh"));
+
+			if (mesh) {
+				gameMesh::ptr faces = std::make_shared<gameMesh>();
+				faces->faces = mesh->faces;
+				setNode("mesh", model, faces);
+			}
+
+			setNode("asdfasdf", holder, model);
+		}
+
+		virtual ~meshCollider() {
+			detach();
+		}
+
+		virtual size_t bytes(void) {
+			// rough guess at what bullet keeps for a BVH triangle mesh,
+			// see makeMeshShape()
+			size_t ret = 0;
+			auto model = std::dynamic_pointer_cast<gameModel>(holder->getNode("asdfasdf"));
+
+			if (model) {
+				ret += model->vertices.size() * 16;
+
+				if (auto mesh = std::dynamic_pointer_cast<gameMesh>(model->getNode("mesh"))) {
+					ret += mesh->faces.size() * 4;
+					ret += mesh->faces.size() / 3 * 32;
+				}
+			}
+
+			return ret;
+		}
+
+		virtual const char *kind(void) {
+			return "mesh";
+		}
+
+	protected:
+		virtual bool addToWorld(gameMain *game) {
+			phys = game->phys;
+			phys->addStaticModels(nullptr, holder, TRS(), objects);
+			return true;
+		}
+
+		virtual void removeFromWorld(void) {
+			for (auto& obj : objects) {
+				phys->removeObject(obj.get());
+			}
+
+			objects.clear();
+			phys = nullptr;
+		}
+
+	private:
+		gameObject::ptr holder = std::make_shared<gameObject>();
+		physics::ptr phys;
+		std::vector<physicsObject::ptr> objects;
+};
+
+terrainCollider::ptr makeHeightfieldCollider(const tileData& data) {
+	return std::make_shared<heightfieldCollider>(data);
+}
+
+terrainCollider::ptr makeMeshCollider(gameModel::ptr model) {
+	return std::make_shared<meshCollider>(model);
+}
+
+bool heightfieldsSupported(gameMain *game) {
+	return bulletWorld(game) != nullptr;
+}
+
+int physicsObjectCount(gameMain *game) {
+	btDiscreteDynamicsWorld *world = bulletWorld(game);
+	return world? world->getNumCollisionObjects() : -1;
+}
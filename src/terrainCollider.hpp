@@ -0,0 +1,66 @@
+#pragma once
+
+#include <grend/gameObject.hpp>
+#include <grend/ecs/ecs.hpp>
+#include <grend/ecs/collision.hpp>
+#include <memory>
+#include <vector>
+
+#include "landscapeTile.hpp"
+
+using namespace grendx;
+
+// collision for one terrain tile. tiles keep their collider while they're
+// cached, but it's only in the physics world while the tile is in the view
+// window, and it's taken out for good when the last reference goes away.
+//
+// colliders can be built on any thread, but attach() and detach() have to
+// be called from the main thread since they touch the physics world
+class terrainCollider {
+	public:
+		typedef std::shared_ptr<terrainCollider> ptr;
+
+		struct counters {
+			// colliders currently in the physics world, and colliders
+			// that exist at all (attached, cached or still being built)
+			size_t attached;
+			size_t alive;
+			size_t attaches;
+			size_t detaches;
+		};
+
+		terrainCollider();
+		virtual ~terrainCollider();
+
+		// adds the collider to the physics world, does nothing if it's
+		// already there
+		bool attach(gameMain *game);
+		// takes it back out, it can be attached again later
+		void detach(void);
+		bool isAttached(void) { return attached; }
+
+		// approximate memory used by the collision shape
+		virtual size_t bytes(void) = 0;
+		virtual const char *kind(void) = 0;
+
+		static counters getCounters(void);
+
+	protected:
+		virtual bool addToWorld(gameMain *game) = 0;
+		virtual void removeFromWorld(void) = 0;
+
+	private:
+		bool attached = false;
+};
+
+// heightfield built straight from the sampled heights, only works with
+// the bullet backend, see heightfieldsSupported()
+terrainCollider::ptr makeHeightfieldCollider(const tileData& data);
+// general triangle mesh, copied from the rendered model so that anything
+// attached to the model later (trees) isn't included
+terrainCollider::ptr makeMeshCollider(gameModel::ptr model);
+
+bool heightfieldsSupported(gameMain *game);
+// everything in the physics world, not just terrain, or -1 if the backend
+// doesn't say
+int physicsObjectCount(gameMain *game);
@@ -0,0 +1,64 @@
+#include <BulletCollision/CollisionShapes/btHeightfieldTerrainShape.h>
+#include <algorithm>
+#include "terrainShape.hpp"
+
+terrainShape makeHeightfieldShape(const tileData& data) {
+	terrainShape ret;
+	unsigned res = data.resolution();
+	float size = (res - 1) * data.unit;
+
+	ret.heights = data.heights;
+
+	auto [lo, hi] = std::minmax_element(ret.heights.begin(), ret.heights.end());
+	float minHeight = *lo * tileData::heightStep;
+	float maxHeight = *hi * tileData::heightStep;
+
+	// rows along z, columns along x, y up. quads are split along the
+	// same diagonal as the rendered mesh (flipQuadEdges off). heights are
+	// used in the same quantized form the tile keeps them in
+	auto field = new btHeightfieldTerrainShape(res, res, ret.heights.data(),
+	                                           tileData::heightStep,
+	                                           minHeight, maxHeight,
+	                                           1, PHY_SHORT, false);
+	field->setLocalScaling(btVector3(data.unit, 1, data.unit));
+	ret.shape.reset(field);
+
+	// heightfields are centered on their bounding box
+	ret.transform.setIdentity();
+	ret.transform.setOrigin(btVector3(data.x + size*0.5f,
+	                                  (minHeight + maxHeight)*0.5f,
+	                                  data.z + size*0.5f));
+
+	ret.bytes = ret.heights.size()*sizeof(int16_t) + sizeof(btHeightfieldTerrainShape);
+	return ret;
+}
+
+terrainShape makeMeshShape(const tileMesh& mesh, glm::vec3 origin) {
+	terrainShape ret;
+	auto tris = new btTriangleMesh(true, false);
+	const auto& indices = *mesh.indices;
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		glm::vec3 a = mesh.positions[indices[i]];
+		glm::vec3 b = mesh.positions[indices[i + 1]];
+		glm::vec3 c = mesh.positions[indices[i + 2]];
+
+		tris->addTriangle(btVector3(a.x, a.y, a.z),
+		                  btVector3(b.x, b.y, b.z),
+		                  btVector3(c.x, c.y, c.z),
+		                  false);
+	}
+
+	ret.mesh.reset(tris);
+	ret.shape.reset(new btBvhTriangleMeshShape(tris, true));
+	ret.transform.setIdentity();
+	ret.transform.setOrigin(btVector3(origin.x, origin.y, origin.z));
+
+	// vertices, indices, and roughly two quantized BVH nodes per triangle
+	size_t ntris = indices.size() / 3;
+	ret.bytes = mesh.positions.size()*sizeof(btVector3)
+	          + indices.size()*sizeof(uint32_t)
+	          + 2*ntris*sizeof(btQuantizedBvhNode)
+	          + sizeof(btBvhTriangleMeshShape);
+	return ret;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <btBulletDynamicsCommon.h>
+#include <memory>
+#include <vector>
+
+#include "landscapeTile.hpp"
+
+// bullet collision shapes for a terrain tile, without anything from the
+// engine so they can be built on worker threads and benchmarked on their own
+struct terrainShape {
+	// heightfield shapes point into this, it has to live as long as
+	// the shape does
+	std::vector<int16_t> heights;
+	std::unique_ptr<btStridingMeshInterface> mesh;
+	std::unique_ptr<btCollisionShape> shape;
+	btTransform transform;
+	// approximate size of the shape and everything it points to
+	size_t bytes = 0;
+};
+
+// heightfield straight from the sampled heights
+terrainShape makeHeightfieldShape(const tileData& data);
+// triangle mesh with a BVH, what the engine builds for static models
+terrainShape makeMeshShape(const tileMesh& mesh, glm::vec3 origin);
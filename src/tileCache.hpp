@@ -0,0 +1,106 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <utility>
+#include <stddef.h>
+
+#include "tileQueue.hpp"
+
+// bounded LRU cache for tiles that left the view window, so walking back
+// over the same ground doesn't rebuild everything from scratch.
+// not thread safe, the generator only uses it from the main thread.
+template <typename T>
+class tileCache {
+	public:
+		struct counters {
+			size_t hits = 0;
+			size_t misses = 0;
+			size_t evictions = 0;
+			size_t residentBytes = 0;
+			size_t residentTiles = 0;
+		};
+
+		tileCache(size_t _budget) : budget(_budget) {}
+
+		void setBudget(size_t bytes) {
+			budget = bytes;
+			evict();
+		}
+
+		size_t getBudget(void) const {
+			return budget;
+		}
+
+		const counters& getCounters(void) const {
+			return stats;
+		}
+
+		void insert(tileCoord coord, T value, size_t bytes) {
+			erase(coord);
+
+			lru.push_front({coord, value, bytes});
+			index[coord] = lru.begin();
+			stats.residentBytes += bytes;
+			stats.residentTiles++;
+			evict();
+		}
+
+		// doesn't count as a hit or miss, or change the LRU order
+		bool contains(tileCoord coord) const {
+			return index.count(coord) != 0;
+		}
+
+		// removes the tile from the cache if it's there, since it's going
+		// back into the live window
+		bool take(tileCoord coord, T& value) {
+			auto it = index.find(coord);
+
+			if (it == index.end()) {
+				stats.misses++;
+				return false;
+			}
+
+			stats.hits++;
+			value = it->second->value;
+			erase(coord);
+			return true;
+		}
+
+		void clear(void) {
+			lru.clear();
+			index.clear();
+			stats.residentBytes = 0;
+			stats.residentTiles = 0;
+		}
+
+	private:
+		struct entry {
+			tileCoord coord;
+			T value;
+			size_t bytes;
+		};
+
+		void erase(tileCoord coord) {
+			auto it = index.find(coord);
+
+			if (it != index.end()) {
+				stats.residentBytes -= it->second->bytes;
+				stats.residentTiles--;
+				lru.erase(it->second);
+				index.erase(it);
+			}
+		}
+
+		void evict(void) {
+			while (stats.residentBytes > budget && !lru.empty()) {
+				erase(lru.back().coord);
+				stats.evictions++;
+			}
+		}
+
+		size_t budget;
+		counters stats;
+		std::list<entry> lru;
+		std::map<tileCoord, typename std::list<entry>::iterator> index;
+};
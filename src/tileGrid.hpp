@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+#include "tileQueue.hpp"
+
+// toroidal store for the tiles in the view window, size*size slots where
+// a tile lives at (x mod size, z mod size). any window of size*size cells
+// maps each cell to a different slot, so a tile coming into view always
+// lands in the slot of the tile on the opposite edge that just left it.
+// not thread safe, the generator only uses it from the main thread.
+template <typename T>
+class tileGrid {
+	public:
+		struct slot {
+			tileCoord coord;
+			bool used = false;
+			T value;
+		};
+
+		tileGrid(int _size = 0) {
+			resize(_size);
+		}
+
+		// throws away everything in the grid
+		void resize(int _size) {
+			size = _size;
+			slots.clear();
+			slots.resize(size*size);
+		}
+
+		int getSize(void) const {
+			return size;
+		}
+
+		T *find(tileCoord coord) {
+			slot& s = slotFor(coord);
+			return (s.used && s.coord == coord)? &s.value : nullptr;
+		}
+
+		// replaces whatever was in the tile's slot
+		T& insert(tileCoord coord) {
+			slot& s = slotFor(coord);
+			s.coord = coord;
+			s.used = true;
+			s.value = T();
+			return s.value;
+		}
+
+		void erase(tileCoord coord) {
+			slot& s = slotFor(coord);
+
+			if (s.used && s.coord == coord) {
+				s.used = false;
+				s.value = T();
+			}
+		}
+
+		// iterates over the slots that hold a tile
+		template <typename F>
+		void forEach(F func) {
+			for (auto& s : slots) {
+				if (s.used) {
+					func(s.coord, s.value);
+				}
+			}
+		}
+
+	private:
+		slot& slotFor(tileCoord coord) {
+			return slots[wrap(coord.second)*size + wrap(coord.first)];
+		}
+
+		int wrap(int n) const {
+			int m = n % size;
+			return (m < 0)? m + size : m;
+		}
+
+		int size;
+		std::vector<slot> slots;
+};
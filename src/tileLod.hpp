@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <stdlib.h>
+
+#include "tileQueue.hpp"
+
+// per level of detail settings, shared by the generator and the headless
+// benchmark so they build exactly the same tiles
+
+// sample spacing for each level of detail, every level's vertices are a
+// subset of the finer levels', so neighbouring tiles only ever differ by
+// the extra vertices along the finer edge
+static const float lodUnits[] = {2.f, 4.f, 8.f};
+// outermost ring (distance from the center cell) drawn at each level
+static const int   lodRings[] = {1, 3, INT_MAX};
+static const unsigned lodLevels = sizeof(lodUnits)/sizeof(lodUnits[0]);
+// skirts have to reach below the worst gap between the coarsest level
+// and the finest one
+static const float skirtDepth = lodUnits[lodLevels - 1];
+
+// grass is split into grassChunks*grassChunks chunks per tile so each one
+// can be culled on its own, with up to this many instances per chunk at
+// each level of detail
+static const unsigned grassChunks = 4;
+static const unsigned lodGrass[] = {48, 8, 0};
+// grass instances in a full window of tiles, the generator's default
+static const size_t defaultGrassBudget = 16384;
+
+static inline unsigned tileLod(tileCoord coord, tileCoord center) {
+	int dist = std::max(abs(coord.first  - center.first),
+	                    abs(coord.second - center.second));
+	unsigned lod = 0;
+
+	while (lod + 1 < lodLevels && dist > lodRings[lod]) {
+		lod++;
+	}
+
+	return lod;
+}
+
+// grass instances in a gridsize*gridsize window with nothing left out
+static inline size_t windowGrass(int gridsize) {
+	int half = gridsize / 2;
+	size_t ret = 0;
+
+	for (int x = -half; x <= half; x++) {
+		for (int y = -half; y <= half; y++) {
+			ret += grassChunks*grassChunks*lodGrass[tileLod({x, y}, {0, 0})];
+		}
+	}
+
+	return ret;
+}
+
+// grass instances per chunk at a level of detail. when a full window would
+// go over budget every level is thinned by the same factor, so the grass a
+// tile gets only depends on its level and the settings, never on which
+// tiles happened to be built first
+static inline unsigned grassPerChunk(unsigned lod, int gridsize, size_t budget) {
+	size_t total = windowGrass(gridsize);
+
+	if (total <= budget) {
+		return lodGrass[lod];
+	}
+
+	return lodGrass[lod] * budget / total;
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <climits>
+#include <stdlib.h>
+
+// integer cell coordinate of a landscape tile
+typedef std::pair<int, int> tileCoord;
+
+// fixed order for tiles around a center, nearest first and then by
+// coordinate. unlike the queue's order it doesn't depend on the lead
+static inline bool nearerTile(tileCoord center, const tileCoord& a,
+                              const tileCoord& b)
+{
+	auto dist = [&] (const tileCoord& c) {
+		int dx = c.first  - center.first;
+		int dy = c.second - center.second;
+		return dx*dx + dy*dy;
+	};
+
+	return std::make_pair(dist(a), a) < std::make_pair(dist(b), b);
+}
+
+// tiles waiting to be generated. worker jobs pop from here when they actually
+// start running rather than being bound to a tile when they're submitted, so
+// the generator can drop or reorder queued tiles as the player moves.
+class tileQueue {
+	public:
+		struct entry {
+			tileCoord coord;
+			unsigned serial;
+			// level of detail to build the tile at
+			unsigned lod;
+			// tiles predicted to come into view soon, only built when
+			// nothing in the current window is waiting
+			bool prefetch;
+			// set by the generator if the tile leaves the window while
+			// it's being built, checked between generation stages
+			std::shared_ptr<std::atomic<bool>> cancelled;
+		};
+
+		void push(entry ent) {
+			std::lock_guard<std::mutex> g(mtx);
+			entries.push_back(ent);
+		}
+
+		// pops the rushed tile if it's queued, otherwise the tile nearest
+		// to the center (shifted by the lead), prefetched tiles come after
+		// everything else
+		bool pop(entry& ent) {
+			std::lock_guard<std::mutex> g(mtx);
+
+			if (entries.empty()) {
+				return false;
+			}
+
+			auto key = [this] (const entry& e) {
+				return std::make_tuple(e.coord != rushed, e.prefetch,
+				                       distance(e.coord));
+			};
+
+			auto best = entries.begin();
+			for (auto it = entries.begin(); it != entries.end(); it++) {
+				if (key(*it) < key(*best)) {
+					best = it;
+				}
+			}
+
+			ent = *best;
+			entries.erase(best);
+			return true;
+		}
+
+		// drops queued tiles further than radius cells from the new center,
+		// returns the number of dropped tiles that were still wanted.
+		// prefetched tiles are outside the window by definition, they're
+		// only dropped once they've been cancelled
+		unsigned retarget(tileCoord newCenter, int radius) {
+			std::lock_guard<std::mutex> g(mtx);
+			unsigned dropped = 0;
+
+			center = newCenter;
+
+			for (auto it = entries.begin(); it != entries.end();) {
+				bool outside =
+					abs(it->coord.first  - center.first)  > radius
+					|| abs(it->coord.second - center.second) > radius;
+
+				if ((outside && !it->prefetch) || *it->cancelled) {
+					// entries for builds that were already replaced
+					// don't count
+					dropped += !*it->cancelled;
+					it = entries.erase(it);
+
+				} else {
+					it++;
+				}
+			}
+
+			return dropped;
+		}
+
+		// prefetched tile is now in the window, build it with everything else
+		void promote(tileCoord coord) {
+			std::lock_guard<std::mutex> g(mtx);
+
+			for (auto& ent : entries) {
+				if (ent.coord == coord) {
+					ent.prefetch = false;
+				}
+			}
+		}
+
+		// distances are measured from this far (in cells) ahead of the
+		// center, so tiles in the direction of travel go first. should be
+		// under half a cell so the center tile stays at the front
+		void setLead(float x, float y) {
+			std::lock_guard<std::mutex> g(mtx);
+			leadX = x;
+			leadY = y;
+		}
+
+		// tile the player is standing on or about to step onto, built
+		// before anything else while it's queued
+		void rush(tileCoord coord) {
+			std::lock_guard<std::mutex> g(mtx);
+			rushed = coord;
+		}
+
+		size_t size(void) {
+			std::lock_guard<std::mutex> g(mtx);
+			return entries.size();
+		}
+
+	private:
+		float distance(const tileCoord& c) const {
+			float dx = c.first  - center.first  - leadX;
+			float dy = c.second - center.second - leadY;
+			return dx*dx + dy*dy;
+		}
+
+		std::mutex mtx;
+		tileCoord center = {0, 0};
+		tileCoord rushed = {INT_MAX, INT_MAX};
+		float leadX = 0, leadY = 0;
+		std::vector<entry> entries;
+};
@@ -0,0 +1,377 @@
+#include <SDL2/SDL.h>
+#include <errno.h>
+#include <string.h>
+#include <vector>
+
+#include "tileStore.hpp"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// tile data is copied in and out as raw floats
+static_assert(sizeof(glm::vec3) == 3*sizeof(float), "unexpected vec3 size");
+static_assert(sizeof(glm::vec4) == 4*sizeof(float), "unexpected vec4 size");
+
+// bump this whenever the record layout or anything that changes the
+// generated data (noise, sampling, tree placement) changes, old files
+// are thrown away when the version doesn't match
+static const uint32_t storeVersion = 5;
+static const char     storeMagic[4] = {'L', 'T', 'I', 'L'};
+static const uint32_t recordMagic = 0x4345524c; // "LREC"
+// written in native order, files from a machine with a different byte
+// order won't match and get thrown away
+static const uint32_t byteOrderMark = 0x01020304;
+
+struct storeHeader {
+	char     magic[4];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint32_t recordHeaderSize;
+};
+
+struct recordHeader {
+	uint32_t magic;
+	// FNV-1a over the header (with this field zeroed) and the payload
+	uint32_t checksum;
+	uint32_t payloadBytes;
+	uint32_t seed;
+	int32_t  x, z;
+	uint32_t resolution;
+	uint32_t samples;
+	uint32_t trees;
+	float    size;
+	float    originX, originZ, unit;
+};
+
+static uint32_t fnv1a(const uint8_t *data, size_t len, uint32_t hash = 2166136261u) {
+	for (size_t i = 0; i < len; i++) {
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static uint32_t recordChecksum(recordHeader header, const uint8_t *payload) {
+	header.checksum = 0;
+	uint32_t hash = fnv1a((const uint8_t*)&header, sizeof(header));
+	return fnv1a(payload, header.payloadBytes, hash);
+}
+
+static size_t payloadSize(uint32_t samples, uint32_t resolution, uint32_t trees) {
+	return sizeof(int16_t)*samples*samples + sizeof(uint16_t)*resolution*resolution
+	     + sizeof(glm::vec4)*trees;
+}
+
+tileStore::tileStore(const std::string& _path, size_t _maxBytes)
+	: path(_path),
+	  maxBytes(_maxBytes)
+{
+	if (!openFile()) {
+		close();
+	}
+}
+
+tileStore::~tileStore() {
+	close();
+}
+
+#if defined(_WIN32)
+// TODO: CreateFileMapping() version
+bool tileStore::openFile(void) {
+	SDL_Log("tileStore: not supported on this platform, not using %s", path.c_str());
+	return false;
+}
+
+bool tileStore::scan(void) { return false; }
+bool tileStore::remap(size_t size) { return false; }
+void tileStore::unmap(void) {}
+void tileStore::close(void) {}
+bool tileStore::save(const key& k, const tileData& data) { return false; }
+
+#else
+bool tileStore::openFile(void) {
+	struct stat st;
+
+	if ((fd = open(path.c_str(), O_RDWR | O_CREAT, 0644)) < 0) {
+		SDL_Log("tileStore: couldn't open %s: %s", path.c_str(), strerror(errno));
+		return false;
+	}
+
+	// appends go wherever this instance thinks the end of the file is,
+	// so only one of them can have it open
+	if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+		SDL_Log("tileStore: %s is already in use, not using it", path.c_str());
+		return false;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		return false;
+	}
+
+	fileSize = st.st_size;
+
+	if (fileSize >= sizeof(storeHeader)) {
+		if (!remap(fileSize)) {
+			return false;
+		}
+
+		storeHeader header;
+		memcpy(&header, mapping, sizeof(header));
+
+		if (memcmp(header.magic, storeMagic, sizeof(storeMagic)) == 0
+		    && header.version == storeVersion
+		    && header.byteOrder == byteOrderMark
+		    && header.recordHeaderSize == sizeof(recordHeader))
+		{
+			return scan();
+		}
+
+		SDL_Log("tileStore: %s has an old or unknown format, starting over",
+		        path.c_str());
+	}
+
+	// new (or discarded) file, write a fresh header
+	storeHeader header;
+	unmap();
+
+	memcpy(header.magic, storeMagic, sizeof(storeMagic));
+	header.version = storeVersion;
+	header.byteOrder = byteOrderMark;
+	header.recordHeaderSize = sizeof(recordHeader);
+
+	if (ftruncate(fd, 0) < 0
+	    || pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+	{
+		SDL_Log("tileStore: couldn't initialize %s: %s", path.c_str(), strerror(errno));
+		return false;
+	}
+
+	fileSize = sizeof(header);
+	stats.fileBytes = fileSize;
+	return true;
+}
+
+bool tileStore::scan(void) {
+	size_t off = sizeof(storeHeader);
+
+	while (off + sizeof(recordHeader) <= fileSize) {
+		recordHeader header;
+		memcpy(&header, mapping + off, sizeof(header));
+
+		size_t end = off + sizeof(header) + header.payloadBytes;
+
+		if (header.magic != recordMagic
+		    || header.payloadBytes != payloadSize(header.samples,
+		                                          header.resolution,
+		                                          header.trees)
+		    || end > fileSize
+		    || header.checksum != recordChecksum(header, mapping + off + sizeof(header)))
+		{
+			break;
+		}
+
+		index[{header.seed, header.x, header.z, header.resolution,
+		       header.size}] = off;
+		off = end;
+	}
+
+	if (off != fileSize) {
+		// torn or corrupt append, everything after the last good record
+		// goes away
+		SDL_Log("tileStore: truncating %s from %zu to %zu bytes",
+		        path.c_str(), fileSize, off);
+
+		if (ftruncate(fd, off) < 0 || !remap(off)) {
+			return false;
+		}
+
+		fileSize = off;
+	}
+
+	stats.fileBytes = fileSize;
+	stats.records = index.size();
+	SDL_Log("tileStore: %s has %zu tiles", path.c_str(), index.size());
+	return true;
+}
+
+void tileStore::unmap(void) {
+	if (mapping) {
+		munmap((void*)mapping, mappedSize);
+		mapping = nullptr;
+		mappedSize = 0;
+	}
+}
+
+bool tileStore::remap(size_t size) {
+	unmap();
+
+	void *ptr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+
+	if (ptr == MAP_FAILED) {
+		SDL_Log("tileStore: couldn't map %s: %s", path.c_str(), strerror(errno));
+		return false;
+	}
+
+	mapping = (const uint8_t*)ptr;
+	mappedSize = size;
+	return true;
+}
+
+void tileStore::close(void) {
+	unmap();
+
+	if (fd >= 0) {
+		::close(fd);
+		fd = -1;
+	}
+}
+
+bool tileStore::save(const key& k, const tileData& data) {
+	uint32_t res = data.resolution();
+	recordHeader header;
+
+	header.magic        = recordMagic;
+	header.checksum     = 0;
+	header.payloadBytes = payloadSize(data.samples, res, data.trees.size());
+	header.seed         = k.seed;
+	header.x            = k.x;
+	header.z            = k.z;
+	header.resolution   = k.resolution;
+	header.samples      = data.samples;
+	header.trees        = data.trees.size();
+	header.size         = k.size;
+	header.originX      = data.x;
+	header.originZ      = data.z;
+	header.unit         = data.unit;
+
+	if (data.heights.size() != data.samples*data.samples
+	    || data.normals.size() != res*res
+	    || k.resolution != res)
+	{
+		return false;
+	}
+
+	// whole record goes out in one write, so a crash can only ever leave
+	// a partial record at the end of the file
+	std::vector<uint8_t> buf(sizeof(header) + header.payloadBytes);
+	uint8_t *payload = buf.data() + sizeof(header);
+	uint8_t *p = payload;
+
+	memcpy(p, data.heights.data(), data.heights.size() * sizeof(int16_t));
+	p += data.heights.size() * sizeof(int16_t);
+	memcpy(p, data.normals.data(), data.normals.size() * sizeof(uint16_t));
+	p += data.normals.size() * sizeof(uint16_t);
+	memcpy(p, data.trees.data(), data.trees.size() * sizeof(glm::vec4));
+
+	header.checksum = recordChecksum(header, payload);
+	memcpy(buf.data(), &header, sizeof(header));
+
+	std::lock_guard<std::mutex> g(mtx);
+
+	if (fd < 0) {
+		return false;
+	}
+
+	// another worker that missed on the same tile got here first
+	if (index.count(k)) {
+		return true;
+	}
+
+	if (fileSize + buf.size() > maxBytes) {
+		if (stats.rejected++ == 0) {
+			SDL_Log("tileStore: %s reached its size cap (%zu bytes), "
+			        "not storing any more tiles", path.c_str(), maxBytes);
+		}
+
+		return false;
+	}
+
+	ssize_t written = pwrite(fd, buf.data(), buf.size(), fileSize);
+
+	if (written != ssize_t(buf.size())) {
+		// don't leave a partial record behind
+		if (ftruncate(fd, fileSize) < 0) {
+			close();
+		}
+
+		return false;
+	}
+
+	index[k] = fileSize;
+	fileSize += buf.size();
+	stats.appends++;
+	stats.records = index.size();
+	stats.fileBytes = fileSize;
+	return true;
+}
+#endif
+
+bool tileStore::load(const key& k, float x, float z, float unit, tileData& data) {
+	std::lock_guard<std::mutex> g(mtx);
+
+	auto it = index.find(k);
+
+	if (fd < 0 || it == index.end()) {
+		stats.misses++;
+		return false;
+	}
+
+	size_t off = it->second;
+
+	// records appended since the last lookup aren't mapped yet
+	if (off + sizeof(recordHeader) > mappedSize
+	    || off + sizeof(recordHeader)
+	       + ((const recordHeader*)(mapping + off))->payloadBytes > mappedSize)
+	{
+		if (!remap(fileSize)) {
+			close();
+			stats.misses++;
+			return false;
+		}
+	}
+
+	recordHeader header;
+	memcpy(&header, mapping + off, sizeof(header));
+
+	// a record for some other tile that ended up under the same key is
+	// as good as no record
+	if (header.originX != x || header.originZ != z || header.unit != unit
+	    || header.samples != k.resolution)
+	{
+		stats.misses++;
+		return false;
+	}
+
+	const uint8_t *p = mapping + off + sizeof(header);
+	uint32_t res = header.resolution;
+
+	data.seed    = header.seed;
+	data.x       = header.originX;
+	data.z       = header.originZ;
+	data.unit    = header.unit;
+	data.samples = header.samples;
+
+	data.heights.resize(header.samples * header.samples);
+	data.normals.resize(res * res);
+	data.trees.resize(header.trees);
+
+	memcpy(data.heights.data(), p, data.heights.size() * sizeof(int16_t));
+	p += data.heights.size() * sizeof(int16_t);
+	memcpy(data.normals.data(), p, data.normals.size() * sizeof(uint16_t));
+	p += data.normals.size() * sizeof(uint16_t);
+	memcpy(data.trees.data(), p, data.trees.size() * sizeof(glm::vec4));
+
+	stats.hits++;
+	return true;
+}
+
+tileStore::counters tileStore::getCounters(void) {
+	std::lock_guard<std::mutex> g(mtx);
+	return stats;
+}
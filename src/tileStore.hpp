@@ -0,0 +1,78 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "landscapeTile.hpp"
+
+// persistent store for generated tile data, one append-only file that's
+// memory-mapped for lookups.
+//
+// layout is a fixed header followed by records, each record has a header
+// with its key, sizes and a checksum, followed by the heights, normals and
+// tree instances raw, packed the same way as in tileData. a record that's
+// cut short or fails its checksum (ie. the game died halfway through an
+// append) marks the end of the file, it's truncated there the next time
+// it's opened.
+//
+// thread safe, lookups and appends can come from any worker thread. only
+// one tileStore can have a file open at a time, across processes too.
+class tileStore {
+	public:
+		struct key {
+			uint32_t seed;
+			int32_t x, z;
+			uint32_t resolution;
+			// tile size in meters, cells are numbered differently
+			// for every size
+			float size;
+
+			bool operator<(const key& other) const {
+				return std::tie(seed, x, z, resolution, size)
+				     < std::tie(other.seed, other.x, other.z,
+				                other.resolution, other.size);
+			}
+		};
+
+		struct counters {
+			size_t hits = 0;
+			size_t misses = 0;
+			size_t appends = 0;
+			// appends refused because the file hit its size cap
+			size_t rejected = 0;
+			size_t fileBytes = 0;
+			size_t records = 0;
+		};
+
+		tileStore(const std::string& path, size_t maxBytes);
+		~tileStore();
+
+		bool isOpen(void) { return fd >= 0; }
+		// only fills in data if the record is for a tile at (x, z)
+		// with the given sample spacing
+		bool load(const key& k, float x, float z, float unit, tileData& data);
+		bool save(const key& k, const tileData& data);
+		counters getCounters(void);
+
+	private:
+		bool openFile(void);
+		bool scan(void);
+		bool remap(size_t size);
+		void unmap(void);
+		void close(void);
+
+		std::mutex mtx;
+		std::string path;
+		size_t maxBytes;
+		counters stats;
+
+		int fd = -1;
+		const uint8_t *mapping = nullptr;
+		size_t mappedSize = 0;
+		size_t fileSize = 0;
+		std::map<key, size_t> index;
+};
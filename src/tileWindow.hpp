@@ -0,0 +1,529 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include <climits>
+#include <math.h>
+
+#include "tileCache.hpp"
+#include "tileGrid.hpp"
+#include "tileLod.hpp"
+#include "tileQueue.hpp"
+
+// bookkeeping for the tiles around the player: which ones are in the view
+// window, staged ahead of where the player is headed or cached after they
+// left it, what's queued to be built, and the tile events that go out as
+// the window moves. doesn't know anything about the engine, T is whatever
+// the owner keeps for a finished tile and anything that touches the scene
+// goes through the callbacks. the generator and landscape-bench both run
+// on this, so the bench (and its verify mode) covers the generator's own
+// scheduling, caching and event order.
+// only the queue is thread safe, everything else is main thread only.
+template <typename T>
+class tileWindow {
+	public:
+		enum eventType {
+			tileStarted,
+			tileGenerated,
+			tileDeleted,
+		};
+
+		struct callbacks {
+			// player crossed into a new cell, before anything moves
+			std::function<void(tileCoord center)> crossed;
+			// a build was pushed onto the queue, once per build
+			std::function<void(void)> queued;
+			// tile goes into the scene, new or replacing itself at
+			// another level of detail
+			std::function<void(tileCoord, const T&, bool replacing)> show;
+			// tile left the window, it's cached right after
+			std::function<void(tileCoord, const T&)> hide;
+			std::function<void(eventType, tileCoord)> event;
+			// size of a finished tile, for the cache budget
+			std::function<size_t(const T&)> bytes;
+		};
+
+		struct counters {
+			// since the last move: queued tiles dropped before they
+			// started, tiles abandoned partway through, tiles in the
+			// new window that were already prefetched and how many of
+			// those were finished, and tiles being rebuilt at a new
+			// level of detail
+			unsigned dropped = 0;
+			unsigned cancelled = 0;
+			unsigned promoted = 0;
+			unsigned promotedReady = 0;
+			unsigned relevelled = 0;
+			// tiles in the window that haven't been shown yet
+			unsigned pending = 0;
+		};
+
+		// finished tiles that left the window, with their level of detail
+		struct cachedTile {
+			T tile;
+			unsigned lod;
+		};
+
+		typedef typename tileCache<cachedTile>::counters cacheCounters;
+
+		tileWindow(int _gridsize, float _cellsize, size_t cacheBytes,
+		           callbacks _cb)
+			: gridsize(_gridsize),
+			  cellsize(_cellsize),
+			  cb(std::move(_cb)),
+			  tiles(_gridsize),
+			  cache(cacheBytes) {}
+
+		// player position and velocity on the ground plane, call every
+		// frame. returns true if the player crossed into another cell
+		bool setPosition(glm::vec2 position, glm::vec2 velocity) {
+			glm::vec2 cell = glm::floor(position / cellsize);
+			tileCoord cur = {int(cell.x), int(cell.y)};
+			bool moved = cur != center;
+
+			if (moved) {
+				move(cur);
+			}
+
+			steer(position, velocity);
+
+			// guess which cell the player will be in by the time
+			// prefetched tiles would be done, at most a couple of cells
+			// out so staging stays bounded at high speeds
+			glm::vec2 ahead = velocity * prefetchSeconds;
+			ahead.x = std::clamp(ahead.x, -2*cellsize, 2*cellsize);
+			ahead.y = std::clamp(ahead.y, -2*cellsize, 2*cellsize);
+			glm::vec2 pred = glm::floor((position + ahead) / cellsize);
+			tileCoord predicted = {int(pred.x), int(pred.y)};
+
+			// nothing worth predicting when standing around
+			if (glm::length(velocity) < minPrefetchSpeed) {
+				predicted = center;
+			}
+
+			if (predicted != lastPredicted) {
+				lastPredicted = predicted;
+				prefetch(predicted);
+			}
+
+			return moved;
+		}
+
+		// false if a finished build is for a tile that left the window,
+		// or was requeued, while it was being built
+		bool wanted(tileCoord coord, unsigned serial) {
+			tileState *state = stateFor(coord);
+			return state && state->serial == serial;
+		}
+
+		// hands over a finished build, shown right away if it's in the
+		// window, otherwise it's kept staged until the player gets there
+		void attach(tileCoord coord, unsigned serial, unsigned lod, const T& tile) {
+			if (!wanted(coord, serial)) {
+				return;
+			}
+
+			if (tiles.find(coord)) {
+				show(coord, tile, lod);
+				return;
+			}
+
+			tileState& state = staged[coord];
+			state.tile = tile;
+			state.ready = true;
+			state.lod = lod;
+			state.cancelled.reset();
+		}
+
+		// index of the finished build in pending to hand over first, in
+		// the same order tiles are built: the rushed tile, then tiles in
+		// the window nearest first, then prefetched ones
+		template <typename U>
+		size_t nextUpload(const std::vector<U>& pending) {
+			auto key = [&] (const U& up) {
+				int dx = up.coord.first  - center.first;
+				int dy = up.coord.second - center.second;
+				return std::make_tuple(up.coord != lastRushed,
+				                       tiles.find(up.coord) == nullptr,
+				                       dx*dx + dy*dy);
+			};
+
+			size_t best = 0;
+			for (size_t i = 1; i < pending.size(); i++) {
+				if (key(pending[i]) < key(pending[best])) {
+					best = i;
+				}
+			}
+
+			return best;
+		}
+
+		// finished tile in the window or staged, null if there isn't one
+		const T *find(tileCoord coord) {
+			tileState *state = stateFor(coord);
+			return (state && state->ready)? &state->tile : nullptr;
+		}
+
+		bool isShown(tileCoord coord) {
+			tileState *state = tiles.find(coord);
+			return state && state->ready;
+		}
+
+		tileCoord getCenter(void) const { return center; }
+		tileQueue& getQueue(void) { return queue; }
+		const counters& getCounters(void) const { return stats; }
+		const cacheCounters& getCacheStats(void) const { return cache.getCounters(); }
+		void setCacheBudget(size_t bytes) { cache.setBudget(bytes); }
+
+	private:
+		// how far ahead to look when prefetching, roughly how long it
+		// takes to get a ring of tiles built, and the slowest speed (m/s)
+		// worth predicting
+		static constexpr float prefetchSeconds = 1.5f;
+		static constexpr float minPrefetchSpeed = 1.f;
+		// how far ahead of the player (in seconds) a tile counts as
+		// about to be walked onto, and how far ahead (in cells) of the
+		// center the queue measures distances from while moving
+		static constexpr float stepSeconds = 0.5f;
+		static constexpr float leadCells = 0.4f;
+
+		struct tileState {
+			T tile;
+			// tile is valid, it's been built (or came out of the cache)
+			bool ready = false;
+			std::shared_ptr<std::atomic<bool>> cancelled;
+			// used to drop results for tiles that were evicted and
+			// requeued while the old job was still running
+			unsigned serial = 0;
+			// level of detail of the current tile, and the level it
+			// should be at for where the player is now. the current tile
+			// stays visible until its replacement is attached
+			unsigned lod = 0;
+			unsigned wantedLod = 0;
+			// generated event has gone out for it
+			bool announced = false;
+		};
+
+		bool inWindow(tileCoord c, tileCoord w) const {
+			int half = gridsize / 2;
+			return abs(c.first  - w.first)  <= half
+			    && abs(c.second - w.second) <= half;
+		}
+
+		tileState *stateFor(tileCoord coord) {
+			if (tileState *live = tiles.find(coord)) {
+				return live;
+			}
+
+			auto it = staged.find(coord);
+			return (it != staged.end())? &it->second : nullptr;
+		}
+
+		void move(tileCoord newCenter) {
+			center = newCenter;
+
+			if (cb.crossed) {
+				cb.crossed(center);
+			}
+
+			// nothing is announced until the new window is set up
+			unannounced.clear();
+			announcedCount = 0;
+			stats = counters();
+
+			// queued tiles outside the new window are dropped before
+			// they start, the rest are picked nearest to the new center
+			stats.dropped = queue.retarget(center, gridsize / 2);
+			unsigned abandoned = 0;
+
+			// drop tiles that fell out of the window, tiles still being
+			// built are told to stop at the next stage, and their results
+			// are ignored in attach() if they finish anyway
+			tiles.forEach([&] (tileCoord c, tileState& tile) {
+				if (inWindow(c, center)) {
+					return;
+				}
+
+				if (tile.cancelled) {
+					// still being built, or rebuilt at a different level
+					*tile.cancelled = true;
+					abandoned++;
+				}
+
+				if (tile.ready) {
+					// keep finished tiles around in case the player
+					// comes back
+					cb.hide(c, tile.tile);
+					cache.insert(c, {tile.tile, tile.lod}, cb.bytes(tile.tile));
+				}
+
+				cb.event(tileDeleted, c);
+				tiles.erase(c);
+			});
+
+			// anything abandoned that wasn't still queued was already
+			// being built
+			stats.cancelled = abandoned - stats.dropped;
+
+			std::vector<tileCoord> missing;
+			int half = gridsize / 2;
+
+			for (int x = -half; x <= half; x++) {
+				for (int y = -half; y <= half; y++) {
+					tileCoord c = {center.first + x, center.second + y};
+					tileState *tile = tiles.find(c);
+
+					if (!tile) {
+						missing.push_back(c);
+
+					} else if (tile->wantedLod != tileLod(c, center)) {
+						// tile moved into a different ring, the current
+						// one stays up until the rebuilt one replaces it
+						queueTile(c, *tile, tileLod(c, center));
+						stats.relevelled++;
+					}
+				}
+			}
+
+			tiles.forEach([&] (tileCoord c, tileState& tile) {
+				if (!tile.ready) {
+					stats.pending++;
+				}
+			});
+
+			for (auto& c : missing) {
+				cachedTile cached;
+				unsigned lod = tileLod(c, center);
+
+				cb.event(tileStarted, c);
+
+				if (promote(c)) {
+					tileState& tile = *tiles.find(c);
+
+					// prefetched for a different center, which may have
+					// put it in a different ring
+					if (tile.wantedLod != lod) {
+						queueTile(c, tile, lod);
+					}
+
+					continue;
+				}
+
+				tileState& tile = tiles.insert(c);
+				tile.wantedLod = lod;
+				stats.pending++;
+
+				if (cache.take(c, cached)) {
+					// a cached tile at the wrong level is still better
+					// than a hole while the right one is built
+					show(c, cached.tile, cached.lod);
+
+					if (cached.lod == lod) {
+						continue;
+					}
+				}
+
+				queueTile(c, tile, lod);
+			}
+
+			// generated events go out nearest first rather than in the
+			// order tiles finish, tiles already shown go out right away
+			tiles.forEach([&] (tileCoord c, tileState& tile) {
+				if (!tile.announced) {
+					unannounced.push_back(c);
+				}
+			});
+
+			std::sort(unannounced.begin(), unannounced.end(),
+			          [&] (const tileCoord& a, const tileCoord& b) {
+				return nearerTile(center, a, b);
+			});
+
+			announceTiles();
+		}
+
+		// moves a staged tile into the window, returns false if it wasn't
+		// staged
+		bool promote(tileCoord coord) {
+			auto st = staged.find(coord);
+
+			if (st == staged.end()) {
+				return false;
+			}
+
+			tileState state = st->second;
+			staged.erase(st);
+			stats.promoted++;
+			stats.pending++;
+
+			if (state.ready) {
+				tiles.insert(coord).wantedLod = state.lod;
+				stats.promotedReady++;
+				show(coord, state.tile, state.lod);
+
+			} else {
+				// still being built, attach() shows it once it's done
+				tiles.insert(coord) = state;
+				queue.promote(coord);
+			}
+
+			return true;
+		}
+
+		void show(tileCoord coord, const T& built, unsigned lod) {
+			tileState& tile = *tiles.find(coord);
+			bool replacing = tile.ready;
+
+			tile.tile = built;
+			tile.ready = true;
+			tile.lod = lod;
+
+			if (tile.lod == tile.wantedLod) {
+				tile.cancelled.reset();
+			}
+
+			if (!replacing) {
+				stats.pending--;
+			}
+
+			cb.show(coord, tile.tile, replacing);
+
+			if (!replacing) {
+				announceTiles();
+			}
+		}
+
+		// sends generated events for shown tiles at the front of
+		// unannounced, so they go out in the same order whatever order
+		// the tiles finish in
+		void announceTiles(void) {
+			while (announcedCount < unannounced.size()) {
+				tileCoord c = unannounced[announcedCount];
+				tileState *tile = tiles.find(c);
+
+				if (!tile->ready) {
+					break;
+				}
+
+				tile->announced = true;
+				cb.event(tileGenerated, c);
+				announcedCount++;
+			}
+		}
+
+		// queues a (re)build of the tile at the given level of detail,
+		// any build already queued or running for it is cancelled
+		void queueTile(tileCoord coord, tileState& tile, unsigned lod,
+		               bool prefetching = false)
+		{
+			if (tile.cancelled) {
+				*tile.cancelled = true;
+			}
+
+			tile.serial = ++serial;
+			tile.wantedLod = lod;
+			tile.cancelled = std::make_shared<std::atomic<bool>>(false);
+			queue.push({coord, tile.serial, lod, prefetching, tile.cancelled});
+
+			if (cb.queued) {
+				cb.queued();
+			}
+		}
+
+		// stages tiles around the predicted cell that aren't in the
+		// current window, and drops staged tiles that aren't needed anymore
+		void prefetch(tileCoord predicted) {
+			int half = gridsize / 2;
+
+			// prediction changed, staged tiles off the new path are
+			// either cached like any other finished tile or cancelled
+			for (auto it = staged.begin(); it != staged.end();) {
+				if (inWindow(it->first, predicted) && !inWindow(it->first, center)) {
+					it++;
+					continue;
+				}
+
+				tileState& tile = it->second;
+
+				if (tile.ready) {
+					cache.insert(it->first, {tile.tile, tile.lod},
+					             cb.bytes(tile.tile));
+
+				} else if (tile.cancelled) {
+					*tile.cancelled = true;
+				}
+
+				it = staged.erase(it);
+			}
+
+			if (predicted == center) {
+				return;
+			}
+
+			for (int x = -half; x <= half; x++) {
+				for (int y = -half; y <= half; y++) {
+					tileCoord c = {predicted.first + x, predicted.second + y};
+
+					if (inWindow(c, center) || staged.count(c) || cache.contains(c)) {
+						continue;
+					}
+
+					queueTile(c, staged[c], tileLod(c, predicted), true);
+				}
+			}
+		}
+
+		// points the queue's lead along the direction of travel, and moves
+		// the tile the player is on, or about to walk onto, to the front
+		// of the queue if it hasn't been built yet
+		void steer(glm::vec2 position, glm::vec2 velocity) {
+			float speed = glm::length(velocity);
+			glm::vec2 heading = (speed < minPrefetchSpeed)? glm::vec2(0) : velocity/speed;
+
+			// cheap enough to do every frame, it only sets a couple of floats
+			queue.setLead(heading.x*leadCells, heading.y*leadCells);
+
+			glm::vec2 step = glm::floor((position + velocity*stepSeconds) / cellsize);
+			tileCoord next = {int(step.x), int(step.y)};
+			tileCoord target = center;
+			tileState *tile = tiles.find(center);
+
+			// ground under the player comes first, then wherever they're
+			// headed
+			if (tile && tile->ready) {
+				tile = tiles.find(next);
+				target = next;
+			}
+
+			if (tile && !tile->ready && target != lastRushed) {
+				lastRushed = target;
+				queue.rush(target);
+			}
+		}
+
+		int gridsize;
+		float cellsize;
+		callbacks cb;
+
+		tileCoord center = {INT_MAX, INT_MAX};
+		tileCoord lastPredicted = {INT_MAX, INT_MAX};
+		tileCoord lastRushed = {INT_MAX, INT_MAX};
+		unsigned serial = 0;
+		tileQueue queue;
+
+		tileGrid<tileState> tiles;
+		// prefetched tiles, built (or being built) but not shown
+		std::map<tileCoord, tileState> staged;
+		tileCache<cachedTile> cache;
+		// tiles in the window without a generated event yet, nearest the
+		// center first, and how many of them have had one since
+		std::vector<tileCoord> unannounced;
+		size_t announcedCount = 0;
+		counters stats;
+};